@@ -7,44 +7,114 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
-#include <iconv.h>
 #include <time.h>
 
 typedef struct timespec timespec;
 
 typedef struct lstime_info {
     const char *path;
-    const char *sortkey; // only used for sorting by path
+    const char *sortkey; // only used for sorting by path or compound keys
     timespec mtime;
     timespec atime;
     timespec ctime;
     timespec btime;
 } lstime_info;
 
+typedef struct lstime_item_op {
+    int directive;      // field letter, or 0 for literal text
+    const char *text;   // literal text, may contain nul bytes
+    size_t len;
+} lstime_item_op;
+
+typedef struct lstime_item_prog {
+    lstime_item_op *ops;
+    size_t num_ops;
+    char *text;         // storage for the literal text of all ops
+} lstime_item_prog;
+
+typedef struct lstime_writer {
+    FILE *fp;           // flushed with fwrite when fd < 0
+    int fd;             // flushed with write(2)/writev(2)
+    char *buf;
+    size_t len;
+    size_t cap;
+} lstime_writer;
+
+#define LSTIME_MAX_SORT_KEYS 5  // mtime, atime, ctime, btime, path
+#define LSTIME_MAX_TIME_LEN 1024
+
+// output buffers and caches for the reentrant (_r) formatters, one per
+// thread; start it zeroed and release it with lstime_format_ctx_free.
+// Results point into it and stay valid until the next call of the same
+// kind.
+struct lstime_time_prog;
+typedef struct lstime_format_ctx {
+    char time_buf[LSTIME_MAX_TIME_LEN];
+    char *quoted_buf;   // grown as needed for quoted paths
+    size_t quoted_cap;
+    struct lstime_time_prog *time_prog;  // last time format, compiled
+} lstime_format_ctx;
+
 typedef struct lstime_options {
     const char *item_format;
+    const lstime_item_prog *item_prog;  // compiled item_format
     const char *time_format;
     const char *path_input_file;
     int stat_flags;
     int path_input_file_delim;
-    int sort_field;
+    int sort_field;                     // first (or only) sort key
+    char sort_keys[LSTIME_MAX_SORT_KEYS + 1];  // all of them, if compound
+    int jobs;
+    int io_engine;
+    int queue_depth;
+    size_t write_buffer_size;
+    size_t limit;
+    size_t max_memory;
     bool reverse;
+    bool recursive;
     bool format_time_as_utc;
     bool debug;
 } lstime_options;
 
+#define LSTIME_NUM_FIELDS 4  // mtime, atime, ctime, btime
+#define LSTIME_ALL_FIELDS 0xfu
+#define LSTIME_NO_FIELDS (1u << LSTIME_NUM_FIELDS)  // paths only
+
+// bump allocator for the buffered path and sort key strings
+typedef struct lstime_arena_chunk lstime_arena_chunk;
+typedef struct lstime_arena {
+    lstime_arena_chunk *chunks;           // newest first
+    char *ptr;                            // free space in the newest chunk
+    size_t avail;
+    size_t total;                         // bytes in all chunks
+} lstime_arena;
+
+// buffered items, struct-of-arrays; use lstime_list_get to read an item
 typedef struct arr_wrapper {
-    lstime_info *arr;
+    const char **paths;
+    const char **sortkeys;                // only used for sorting by path/compound
+    int64_t *secs[LSTIME_NUM_FIELDS];     // NULL for fields not kept
+    int32_t *nsecs[LSTIME_NUM_FIELDS];    // -1 for N/A
+    unsigned fields;                      // bit mask of kept fields, 0 for all
+    lstime_arena strings;                 // owns paths and sortkeys
+    size_t limit;                         // --limit: items kept, 0 for all
+    bool keyed;                           // --limit: sortkeys kept per item
+    bool collate_bytes;                   // --limit: byte order paths
+    size_t *seqs;                         // --limit: arrival order per item
+    size_t *heap;                         // --limit: item indexes
+    size_t num_seen;                      // items offered so far
+    size_t live_bytes;                    // --limit: string bytes in use
+    size_t dead_bytes;                    // --limit: string bytes replaced
     size_t capacity;
     size_t num_elems;
 } arr_wrapper;
 
 
-void lstime_of_path(FILE *fpout,
+void lstime_of_path(lstime_writer *out,
                     arr_wrapper *list,
                     const lstime_options *opts,
                     const char *path);
-void lstime_parse_path_input_file(FILE *fpout,
+void lstime_parse_path_input_file(lstime_writer *out,
                                   arr_wrapper *list,
                                   const lstime_options *opts,
                                   const char *path);
@@ -52,24 +122,85 @@ void lstime_set_option_defaults(lstime_options *opts);
 void lstime_parse_options(lstime_options *opts, int argc, char *argv[]);
 void lstime_show_option_settings(const lstime_options *opts, FILE *fp);
 int lstime_stat_path(lstime_info *info, int stat_flags);
+int lstime_stat_path_at(int dirfd,
+                        const char *name,
+                        lstime_info *info,
+                        int stat_flags);
 void lstime_sort_list(arr_wrapper *list, const lstime_options *opts);
-void lstime_output_list(FILE *fpout,
+void lstime_output_list(lstime_writer *out,
                         const arr_wrapper *list,
                         const lstime_options *opts);
 const char *lstime_format_path(const char *path, bool escape_uni, bool debug);
+const char *lstime_format_path_r(lstime_format_ctx *ctx,
+                                 const char *path,
+                                 bool escape_uni,
+                                 bool debug);
 const char *lstime_format_timestamp(const timespec ts,
                                     const char *time_format,
                                     bool format_time_as_utc);
-void lstime_output_item(FILE *fp,
+const char *lstime_format_timestamp_r(lstime_format_ctx *ctx,
+                                      const timespec ts,
+                                      const char *time_format,
+                                      bool format_time_as_utc);
+void lstime_format_ctx_free(lstime_format_ctx *ctx);
+lstime_item_prog *lstime_compile_item_format(const char *item_format);
+void lstime_free_item_prog(lstime_item_prog *prog);
+void lstime_run_item_prog(lstime_writer *out,
+                          const lstime_info *info,
+                          const lstime_item_prog *prog,
+                          const char *time_format,
+                          bool utc,
+                          bool debug);
+void lstime_run_item_prog_r(lstime_format_ctx *ctx,
+                            lstime_writer *out,
+                            const lstime_info *info,
+                            const lstime_item_prog *prog,
+                            const char *time_format,
+                            bool utc,
+                            bool debug);
+void lstime_output_item(lstime_writer *out,
                         const lstime_info *info,
                         const lstime_options *opts);
+void lstime_output_item_r(lstime_format_ctx *ctx,
+                          lstime_writer *out,
+                          const lstime_info *info,
+                          const lstime_options *opts);
 void lstime_out_it(FILE *fp,
                    const lstime_info *info,
                    const char* item_format,
                    const char *time_format,
                    bool format_time_as_utc,
                    bool debug);
-void add_info_to_list(arr_wrapper *list, const lstime_info *info);
+void lstime_writer_init_fp(lstime_writer *w, FILE *fp, size_t cap);
+void lstime_writer_init_fd(lstime_writer *w, FILE *fp, size_t cap);
+void lstime_writer_write(lstime_writer *w, const char *data, size_t len);
+void lstime_writer_puts(lstime_writer *w, const char *str);
+void lstime_writer_flush(lstime_writer *w);
+void lstime_writer_finit(lstime_writer *w);
+void add_info_to_list(arr_wrapper *list, const lstime_info *info);  // copies path
+void lstime_list_offer(arr_wrapper *list,
+                       const lstime_options *opts,
+                       const lstime_info *info);
+void lstime_list_get(const arr_wrapper *list, size_t i, lstime_info *info);
+void lstime_list_free(arr_wrapper *list);
+void lstime_emit_info(lstime_writer *out,
+                      arr_wrapper *list,
+                      const lstime_options *opts,
+                      const lstime_info *info);
+void lstime_emit_info_r(lstime_format_ctx *ctx,
+                        lstime_writer *out,
+                        arr_wrapper *list,
+                        const lstime_options *opts,
+                        const lstime_info *info);
+void lstime_stat_pool_submit(lstime_writer *out,
+                             arr_wrapper *list,
+                             const lstime_options *opts,
+                             const char *path);
+void lstime_stat_pool_finish(void);
+void lstime_walk_path(lstime_writer *out,
+                      arr_wrapper *list,
+                      const lstime_options *opts,
+                      const char *path);
 void lstime_driver(FILE *fpout, int argc, char *argv[]);
 
 #endif
@@ -0,0 +1,74 @@
+// SPDX-FileCopyrightText: © 2023 Daniel D. Mickey III
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "lstime_private.h"
+
+// Bump allocator for string data (paths and sort keys): strings are
+// packed into large chunks and only ever freed all at once, so buffering
+// millions of paths costs a few allocations instead of one per path.
+// No alignment is kept, as everything stored is char data.
+
+#define ARENA_MIN_CHUNK (64 * 1024)
+#define ARENA_MAX_CHUNK (4 * 1024 * 1024)
+
+struct lstime_arena_chunk {
+    lstime_arena_chunk *next;
+    size_t size;
+    char data[];
+};
+
+static void arena_new_chunk(lstime_arena *a, size_t need) {
+    size_t size = (a->chunks == NULL) ? ARENA_MIN_CHUNK :
+        MIN(a->chunks->size * 2, ARENA_MAX_CHUNK);
+    size = MAX(size, need);
+    lstime_arena_chunk *chunk = malloc(sizeof(lstime_arena_chunk) + size);
+    if (chunk == NULL) {
+        err("arena out of memory: %s", strerror(errno));
+        exit(49);
+    }
+    chunk->next = a->chunks;
+    chunk->size = size;
+    a->chunks = chunk;
+    a->total += size;
+    a->ptr = chunk->data;
+    a->avail = size;
+}
+
+char *lstime_arena_alloc(lstime_arena *a, size_t size) {
+    if (size > a->avail) {
+        arena_new_chunk(a, size);
+    }
+    char *ptr = a->ptr;
+    a->ptr += size;
+    a->avail -= size;
+    return ptr;
+}
+
+char *lstime_arena_strdup(lstime_arena *a, const char *str) {
+    size_t len = strlen(str) + 1;
+    return memcpy(lstime_arena_alloc(a, len), str, len);
+}
+
+// forget all strings, but keep the newest (largest) chunk for reuse
+void lstime_arena_reset(lstime_arena *a) {
+    if (a->chunks == NULL) {
+        return;
+    }
+    lstime_arena_chunk *keep = a->chunks;
+    lstime_arena_chunk *chunk = keep->next;
+    while (chunk != NULL) {
+        lstime_arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    keep->next = NULL;
+    a->total = keep->size;
+    a->ptr = keep->data;
+    a->avail = keep->size;
+}
+
+void lstime_arena_free(lstime_arena *a) {
+    lstime_arena_reset(a);
+    free(a->chunks);
+    memset(a, 0, sizeof(*a));
+}
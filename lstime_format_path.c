@@ -6,8 +6,6 @@
 
 #include "lstime_private.h"
 
-#define MIN(a,b) (((a)<(b))?(a):(b))
-#define MAX(a,b) (((a)>(b))?(a):(b))
 #define LEVEL1 1  // no quoting needed, just graphic ASCII
 #define LEVEL2 2  // has space or shell specials, single-quotes needed
 #define LEVEL3 3  // has multi-byte UTF-8, single-quotes needed
@@ -17,35 +15,16 @@
 
 static const char *hex = "0123456789ABCDEF";
 
-static int copy_bytes_to_cps(uint32_t *cps, size_t capacity, const char *str) {
-    size_t len = strlen(str);
-    if (len > capacity) {
-        err("copy_bytes_to_cps: cps buffer cannot hold %zu bytes", len);
-        exit(27);
-    }
-
-    while (*str != '\0') {
-        *cps++ = (*str++ & 0xFF);
-    }
-    return len;
-}
-
-static char *bash_u_escape(wchar_t cp) {
-    static char buf[12];
-    const char *fmt;
-    if (cp <= 0xFFFF) {
-        fmt = "\\u%04X";
-    } else {
-        fmt = "\\U%08X";
-    }
-    sprintf(buf, fmt, cp);
-    return buf;
-}
-
-static int parse_for_display_level(const char *path, int min_level, bool escape_uni) {
+static int parse_for_display_level(const char *path,
+                                   size_t len,
+                                   int min_level,
+                                   bool escape_uni) {
     int level = min_level;
-    for (const char *ptr = path; *ptr != '\0'; ptr++) {
-        unsigned char c = (unsigned char) *ptr;
+    int max_level = escape_uni ? LEVEL5 : LEVEL4;
+    // runs of plain bytes are skipped in bulk, only the others looked at
+    size_t i = lstime_plain_span(path, len);
+    while (i < len && level < max_level) {
+        unsigned char c = (unsigned char) path[i++];
         switch (c) {
         case ' ':
         case '\"':
@@ -89,16 +68,63 @@ static int parse_for_display_level(const char *path, int min_level, bool escape_
             }
             break;
         }
+        i += lstime_plain_span(path + i, len - i);
     }
     return level;
 }
 
-static const char *bash_quote_cps(const uint32_t *cps,
-                                  size_t cps_len,
+// Output is written to the ctx buffer, grown up front to hold the worst
+// case for the path, so the emitters below never check for room: at most
+// 6 bytes per path byte (a control code as \u0001), plus $'' and the nul.
+static char *reserve_quoted(lstime_format_ctx *ctx, size_t len) {
+    size_t need = 6 * len + 4;
+    if (need > ctx->quoted_cap) {
+        size_t cap = MAX(need, 2 * ctx->quoted_cap);
+        char *buf = realloc(ctx->quoted_buf, cap);
+        if (buf == NULL) {
+            err("format path out of memory: %s", strerror(errno));
+            exit(13);
+        }
+        ctx->quoted_buf = buf;
+        ctx->quoted_cap = cap;
+    }
+    return ctx->quoted_buf;
+}
+
+// letters of the single character escapes in $'...', by ASCII code
+static const char escape_letters[128] = {
+    ['\a'] = 'a', ['\b'] = 'b', [033] = 'E', ['\f'] = 'f', ['\n'] = 'n',
+    ['\r'] = 'r', ['\t'] = 't', ['\v'] = 'v', ['\\'] = '\\', ['\''] = '\'',
+    ['\"'] = '\"',
+};
+
+// \uHHHH, or \UHHHHHHHH beyond the BMP
+static inline char *put_u_escape(char *qptr, uint32_t cp) {
+    int shift = (cp <= 0xFFFF) ? 12 : 28;
+    *qptr++ = '\\';
+    *qptr++ = (cp <= 0xFFFF) ? 'u' : 'U';
+    for ( ; shift >= 0; shift -= 4) {
+        *qptr++ = hex[(cp >> shift) & 0x0F];
+    }
+    return qptr;
+}
+
+static inline char *put_x_escape(char *qptr, unsigned char c) {
+    *qptr++ = '\\';
+    *qptr++ = 'x';
+    *qptr++ = hex[c >> 4];
+    *qptr++ = hex[c & 0x0F];
+    return qptr;
+}
+
+// quotes and escapes the bytes of path, except that at LEVEL5 (where
+// path is known to be valid UTF-8) code points are decoded for escapes
+static const char *bash_quote_cps(lstime_format_ctx *ctx,
+                                  const char *path,
+                                  size_t len,
                                   int disp_level) {
-    static char quoted_buf[MAX_PATH_LEN];
-    char *qptr = quoted_buf;
-    uint32_t cp;
+    char *qptr = reserve_quoted(ctx, len);
+    const char *end = path + len;
 
     if (disp_level >= LEVEL4) {
         *qptr++ = '$';
@@ -107,93 +133,70 @@ static const char *bash_quote_cps(const uint32_t *cps,
         *qptr++ = '\'';
     }
 
-    while (cps_len-- > 0) {
-        cp = *cps++;
-        if ((size_t)(qptr - quoted_buf) > sizeof(quoted_buf) - 12) {
-            // \UHHHHHHHH + close quote + nul == 12
-            // 12 more bytes might be needed
-            err("bash_quote_cps: quoted_buf len %zu exceeded", sizeof(quoted_buf));
-            exit(13);
-        }
-
-        if (disp_level <= LEVEL3) {
-            *qptr++ = cp;
-        } else {  // >= LEVEL4
-            switch (cp) {
-            case '\a': *qptr++ = '\\'; *qptr++ = 'a'; break;
-            case '\b': *qptr++ = '\\'; *qptr++ = 'b'; break;
-            case 033:  *qptr++ = '\\'; *qptr++ = 'E'; break;
-            case '\f': *qptr++ = '\\'; *qptr++ = 'f'; break;
-            case '\n': *qptr++ = '\\'; *qptr++ = 'n'; break;
-            case '\r': *qptr++ = '\\'; *qptr++ = 'r'; break;
-            case '\t': *qptr++ = '\\'; *qptr++ = 't'; break;
-            case '\v': *qptr++ = '\\'; *qptr++ = 'v'; break;
-            case '\\': *qptr++ = '\\'; *qptr++ = '\\'; break;
-            case '\'': *qptr++ = '\\'; *qptr++ = '\''; break;
-            case '\"': *qptr++ = '\\'; *qptr++ = '\"'; break;
-            // case '\?': *qptr++ = '\\'; *qptr++ = '\?'; break;
-            default:
-                if (cp >= 0x20 && cp <= 0x7E) {
-                    *qptr++ = cp;
-                } else {
-                    if (disp_level == LEVEL4) {
-                        if (cp <= 0x7F) {
-                            // control codes escaped
-                            strcpy(qptr, bash_u_escape(cp));
-                            qptr += strlen(qptr);
-                        } else {
-                            // pass thru multi-byte UTF-8
-                            *qptr++ = cp;
-                        }
-                    } else if (disp_level == LEVEL5) {
-                        // control codes and multi-byte UTF-8 escaped
-                        strcpy(qptr, bash_u_escape(cp));
-                        qptr += strlen(qptr);
-                    } else if (disp_level == LEVEL6) {
-                        // display all non-ASCII as hex
-                        *qptr++ = '\\';
-                        *qptr++ = 'x';
-                        *qptr++ = hex[cp >> 4];
-                        *qptr++ = hex[cp & 0x0F];
-                    } else {
-                    }
-                }
-                break;
-            }
+    if (disp_level <= LEVEL3) {  // no escapes, just copied
+        memcpy(qptr, path, len);
+        qptr += len;
+        path = end;
+    }
+    while (path < end) {
+        unsigned char c = (unsigned char) *path++;
+        if (c < 0x80 && escape_letters[c] != 0) {
+            *qptr++ = '\\';
+            *qptr++ = escape_letters[c];
+        } else if (c >= 0x20 && c <= 0x7E) {
+            *qptr++ = (char) c;
+        } else if (disp_level == LEVEL6) {
+            // display all non-ASCII and control codes as hex
+            qptr = put_x_escape(qptr, c);
+        } else if (c <= 0x7F) {
+            // control codes escaped
+            qptr = put_u_escape(qptr, c);
+        } else if (disp_level == LEVEL5) {
+            // multi-byte UTF-8 escaped
+            uint32_t cp;
+            path += lstime_utf8_decode(path - 1, end - path + 1, &cp) - 1;
+            qptr = put_u_escape(qptr, cp);
+        } else {
+            // pass thru multi-byte UTF-8
+            *qptr++ = (char) c;
         }
     }
 
     if (disp_level >= LEVEL2) {
         *qptr++ = '\'';
     }
-    *qptr++ = '\0';
-    return quoted_buf;
+    *qptr = '\0';
+    return ctx->quoted_buf;
 }
 
-const char *lstime_format_path(const char *path, bool escape_uni, bool debug) {
-    int disp_level = parse_for_display_level(path, LEVEL1, escape_uni);
-    uint32_t *cps_buf = lstime_outbuf();
-    size_t cps_len = 0;
-
-    if (disp_level >= LEVEL3 || disp_level <= LEVEL5) {
-        // conversion to UTF-32 verifies UTF-8 is valid
-        // and provides code point values for escapes
-        if (lstime_iconv(path, debug)) {
-            // successful
-            cps_len = lstime_outbuf_len();
-        } else {
+const char *lstime_format_path_r(lstime_format_ctx *ctx,
+                                 const char *path,
+                                 bool escape_uni,
+                                 bool debug) {
+    size_t len = strlen(path);
+    int disp_level = parse_for_display_level(path, len, LEVEL1, escape_uni);
+    if (disp_level == LEVEL1) {
+        return path;  // plain ASCII, nothing to convert or copy
+    }
+
+    if (disp_level >= LEVEL3 && disp_level <= LEVEL5) {
+        // UTF-8 must be valid to be passed thru or decoded for escapes
+        size_t valid_len = lstime_utf8_valid_len(path, len);
+        if (valid_len != len) {
             // problem with UTF-8, likely unexpected binary
             // so failover and display as all hex
+            if (debug) {
+                warn("invalid UTF-8 at byte %zu of path", valid_len);
+            }
             disp_level = MAX(disp_level, LEVEL6);
         }
     }
 
-    if (disp_level != LEVEL5) {
-        // only LEVEL5 actually needs the UTF-32 values
-        // the others can be formatted from the original byte values
-        cps_len = copy_bytes_to_cps(cps_buf, lstime_outbuf_capacity(), path);
-    }
+    return bash_quote_cps(ctx, path, len, disp_level);
+}
 
-    return bash_quote_cps(cps_buf, cps_len, disp_level);
+const char *lstime_format_path(const char *path, bool escape_uni, bool debug) {
+    return lstime_format_path_r(lstime_thread_format_ctx(), path, escape_uni,
+                                debug);
 }
 
@@ -21,6 +21,13 @@ static bool test_plain_2() {
     return true;
 }
 
+static bool test_plain_no_copy() {
+    const char *path = "usr/include/stdio.h";
+    du_assert_int_eq(lstime_format_path(path, true, false) == path, true,
+                     "LEVEL1 path output as is");
+    return true;
+}
+
 static bool test_shell_meta() {
     const char *rc = lstime_format_path("abc$def", false, false);
     du_assert_str_eq(rc, "'abc$def'", "shell meta LEVEL2 path");
@@ -74,9 +81,92 @@ static bool test_binary_2() {
     return true;
 }
 
+static bool test_binary_3() {
+    // an overlong encoding of '/' with otherwise LEVEL3 bytes
+    const char *rc = lstime_format_path("a b\xC0\xAF", false, false);
+    du_assert_str_eq(rc, "$'a b\\xC0\\xAF'", "binary LEVEL6 paths");
+    return true;
+}
+
+// what RFC 3629 allows is passed thru or escaped; the rest is binary
+static bool test_utf8_edges() {
+    du_assert_str_eq(lstime_format_path("\xF0\x9F\x98\x80 x", true, false),
+                     "$'\\U0001F600 x'", "4 byte UTF-8");
+    du_assert_str_eq(lstime_format_path("\xF4\x8F\xBF\xBF\xEF\xBF\xBF\xC2\x80", true, false),
+                     "$'\\U0010FFFF\\uFFFF\\u0080'", "largest and smallest");
+    du_assert_str_eq(lstime_format_path("\xF4\x90\x80\x80", false, false),
+                     "$'\\xF4\\x90\\x80\\x80'", "beyond U+10FFFF");
+    du_assert_str_eq(lstime_format_path("\xED\xA0\x80", false, false),
+                     "$'\\xED\\xA0\\x80'", "surrogate");
+    du_assert_str_eq(lstime_format_path("\xE0\x80\xAF", true, false),
+                     "$'\\xE0\\x80\\xAF'", "overlong 3 byte");
+    du_assert_str_eq(lstime_format_path("ab\xE2\x82", false, false),
+                     "$'ab\\xE2\\x82'", "truncated");
+    du_assert_str_eq(lstime_format_path("\x80" "abc", false, false),
+                     "$'\\x80abc'", "stray continuation byte");
+    du_assert_str_eq(lstime_format_path("0123456789abcdef0123456789\xC3\xA9", true, false),
+                     "$'0123456789abcdef0123456789\\u00E9'", "after an ASCII block");
+    return true;
+}
+
+// special bytes at every offset of paths long enough for the block scans
+static bool test_long_paths() {
+    char path[96];
+    char expected[128];
+    for (int pos = 0; pos < 80; ++pos) {
+        memset(path, 0, sizeof(path));
+        memset(path, 'a', 80);
+        path[pos] = ' ';
+        snprintf(expected, sizeof(expected), "'%s'", path);
+        du_assert_str_eq(lstime_format_path(path, false, false), expected, "space");
+
+        path[pos] = '\'';
+        snprintf(expected, sizeof(expected), "$'%.*s\\'%s'", pos, path, path + pos + 1);
+        du_assert_str_eq(lstime_format_path(path, false, false), expected, "quote");
+
+        path[pos] = '\xC3';   // e acute, taking the next byte
+        path[pos + 1] = '\xA9';
+        snprintf(expected, sizeof(expected), "'%s'", path);
+        du_assert_str_eq(lstime_format_path(path, false, false), expected, "utf-8");
+
+        path[pos] = '\x01';
+        path[pos + 1] = '_';
+        snprintf(expected, sizeof(expected), "$'%.*s\\u0001_%s'", pos, path, path + pos + 2);
+        du_assert_str_eq(lstime_format_path(path, false, false), expected, "control");
+    }
+    return true;
+}
+
+// the worst case, every byte a \u escape, well past MAX_PATH_LEN
+static bool test_escape_worst_case() {
+    static char path[5000];
+    memset(path, '\x01', sizeof(path) - 1);
+    const char *rc = lstime_format_path(path, true, false);
+    du_assert_int_eq(strlen(rc), 3 + 6 * (sizeof(path) - 1), "all escaped");
+    du_assert_int_eq(strncmp(rc, "$'\\u0001\\u0001", 14), 0, "leading escapes");
+    du_assert_str_eq(rc + strlen(rc) - 7, "\\u0001'", "trailing escape and quote");
+    return true;
+}
+
+// results in separate contexts are not overwritten by each other
+static bool test_format_path_r() {
+    lstime_format_ctx ctx1 = { 0 };
+    lstime_format_ctx ctx2 = { 0 };
+    const char *rc1 = lstime_format_path_r(&ctx1, "abc$def", false, false);
+    const char *rc2 = lstime_format_path_r(&ctx2, "bell\a", false, false);
+    const char *rc = lstime_format_path("xyz\x01", false, false);
+    du_assert_str_eq(rc1, "'abc$def'", "first ctx");
+    du_assert_str_eq(rc2, "$'bell\\a'", "second ctx");
+    du_assert_str_eq(rc, "$'xyz\\u0001'", "thread ctx");
+    lstime_format_ctx_free(&ctx1);
+    lstime_format_ctx_free(&ctx2);
+    return true;
+}
+
 int format_path_suite(void) {
     du_add(test_plain());
     du_add(test_plain_2());
+    du_add(test_plain_no_copy());
     du_add(test_shell_meta());
     du_add(test_shell_meta_2());
     du_add(test_u_escapes());
@@ -85,5 +175,10 @@ int format_path_suite(void) {
     du_add(test_control_codes_2());
     du_add(test_binary());
     du_add(test_binary_2());
+    du_add(test_binary_3());
+    du_add(test_utf8_edges());
+    du_add(test_long_paths());
+    du_add(test_escape_worst_case());
+    du_add(test_format_path_r());
     return du_suite_summary("lstime_format_path Test Suite Summary");
 }
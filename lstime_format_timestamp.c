@@ -5,145 +5,518 @@
 
 #include "lstime_private.h"
 
-static void tm_from_timespec(struct tm *tm, timespec ts, bool use_utc) {
-    time_t timet = ts.tv_sec;
+// Converting a timestamp is plain arithmetic on the epoch seconds plus
+// a UTC offset.  The local offset for each day is looked up once with
+// localtime_r and kept in a small per-thread cache, which avoids the
+// glibc tz lock and TZ re-checks on every call.  Days with an offset
+// transition (DST changes) are not cached and use localtime_r directly,
+// and so are days where the arithmetic disagrees with the C library,
+// as in zones with leap seconds (the "right/" zones, UTC included).
+
+#define SECS_PER_DAY 86400
+#define TZ_CACHE_SLOTS 64
+#define ARITH_TIME_LIMIT (1LL << 40)  // about +-34000 years
+
+typedef struct tz_cache_entry {
+    int64_t day;
+    long gmtoff;
+    const char *zone;
+    int isdst;
+    bool uniform;   // same offset for the whole day, plain arithmetic
+    bool valid;
+} tz_cache_entry;
+
+static _Thread_local tz_cache_entry tz_cache[2][TZ_CACHE_SLOTS];  // local, UTC
+
+// for tests, or after the TZ environment variable changes
+void lstime_tz_cache_reset(void) {
+    memset(tz_cache, 0, sizeof(tz_cache));
+}
+
+static int64_t floor_div(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+// break down seconds since the epoch (already offset) into tm fields,
+// using the days-to-civil algorithm from Howard Hinnant
+static void tm_from_epoch_secs(struct tm *tm, int64_t secs) {
+    int64_t days = floor_div(secs, SECS_PER_DAY);
+    int64_t rem = secs - days * SECS_PER_DAY;
+    tm->tm_hour = rem / 3600;
+    tm->tm_min = (rem % 3600) / 60;
+    tm->tm_sec = rem % 60;
+    tm->tm_wday = (int)(((days % 7) + 11) % 7);  // 1970-01-01 was Thursday
+
+    int64_t z = days + 719468;
+    int64_t era = floor_div(z, 146097);
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int64_t mday = doy - (153 * mp + 2) / 5 + 1;
+    int64_t mon = (mp < 10) ? mp + 3 : mp - 9;
+    int64_t year = yoe + era * 400 + (mon <= 2);
+
+    tm->tm_year = (int)(year - 1900);
+    tm->tm_mon = (int)(mon - 1);
+    tm->tm_mday = (int) mday;
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    static const int cum_days[12] =
+        { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+    tm->tm_yday = cum_days[mon - 1] + (int) mday - 1 +
+        ((leap && mon > 2) ? 1 : 0);
+}
+
+static void localtime_or_exit(time_t timet, struct tm *tm) {
+    if (!localtime_r(&timet, tm)) {
+        err("localtime_r: %s", strerror(errno));
+        exit(6);
+    }
+}
+
+static void gmtime_or_exit(time_t timet, struct tm *tm) {
+    if (!gmtime_r(&timet, tm)) {
+        err("gmtime_r: %s", strerror(errno));
+        exit(5);
+    }
+}
+
+// does the arithmetic break down of secs (offset by gmtoff) give tm?
+static bool tm_matches_arith(const struct tm *tm, int64_t secs, long gmtoff) {
+    struct tm arith;
+    tm_from_epoch_secs(&arith, secs + gmtoff);
+    return tm->tm_sec == arith.tm_sec && tm->tm_min == arith.tm_min &&
+        tm->tm_hour == arith.tm_hour && tm->tm_mday == arith.tm_mday &&
+        tm->tm_mon == arith.tm_mon && tm->tm_year == arith.tm_year &&
+        tm->tm_wday == arith.tm_wday && tm->tm_yday == arith.tm_yday;
+}
+
+static const tz_cache_entry *tz_cache_lookup(int64_t secs, bool use_utc) {
+    int64_t day = floor_div(secs, SECS_PER_DAY);
+    tz_cache_entry *ent = &tz_cache[use_utc][(uint64_t) day % TZ_CACHE_SLOTS];
+    if (ent->valid && ent->day == day) {
+        return ent;
+    }
+
+    int64_t first_sec = day * SECS_PER_DAY;
+    int64_t last_sec = first_sec + SECS_PER_DAY - 1;
+    struct tm first;
+    struct tm last;
     if (use_utc) {
-        if (!gmtime_r(&timet, tm)) {
-            err("gmtime_r: %s", strerror(errno));
-            exit(5);
-        }
+        gmtime_or_exit(first_sec, &first);
+        gmtime_or_exit(last_sec, &last);
     } else {
-        if (!localtime_r(&timet, tm)) {
-            err("localtime_r: %s", strerror(errno));
-            exit(6);
+        localtime_or_exit(first_sec, &first);
+        localtime_or_exit(last_sec, &last);
+    }
+    ent->day = day;
+    ent->gmtoff = first.tm_gmtoff;
+    ent->zone = first.tm_zone;
+    ent->isdst = first.tm_isdst;
+    ent->uniform = first.tm_gmtoff == last.tm_gmtoff &&
+        first.tm_isdst == last.tm_isdst &&
+        first.tm_zone != NULL && last.tm_zone != NULL &&
+        strcmp(first.tm_zone, last.tm_zone) == 0 &&
+        tm_matches_arith(&first, first_sec, first.tm_gmtoff) &&
+        tm_matches_arith(&last, last_sec, first.tm_gmtoff);
+    ent->valid = true;
+    return ent;
+}
+
+static void tm_from_timespec(struct tm *tm, timespec ts, bool use_utc) {
+    time_t timet = ts.tv_sec;
+    const tz_cache_entry *ent = NULL;
+    if (ts.tv_sec >= -ARITH_TIME_LIMIT && ts.tv_sec <= ARITH_TIME_LIMIT) {
+        ent = tz_cache_lookup(ts.tv_sec, use_utc);
+    }
+    if (ent == NULL || !ent->uniform) {
+        // out of range (errors left to the C library), or not plain arithmetic
+        if (use_utc) {
+            gmtime_or_exit(timet, tm);
+        } else {
+            localtime_or_exit(timet, tm);
         }
+        return;
+    }
+    tm_from_epoch_secs(tm, ts.tv_sec + ent->gmtoff);
+    tm->tm_isdst = ent->isdst;
+    tm->tm_gmtoff = ent->gmtoff;
+    tm->tm_zone = ent->zone;
+}
+
+// The time format is compiled once into segments: literal text, the
+// %N and %:z extensions, hand-written formatters for the common numeric
+// specifiers, and strftime chunks for everything else (locale names,
+// flags, widths).  Each strftime chunk ends with a sentinel character so
+// an empty expansion can be told apart from a full buffer.
+
+#define SEG_LITERAL   0
+#define SEG_STRFTIME  1
+#define SEG_NSEC      2   // %N, %3N, ...
+#define SEG_COLON_Z   3   // %:z
+#define SEG_Z         4   // %z
+#define SEG_DATE      5   // %F
+#define SEG_TIME      6   // %T
+#define SEG_YEAR      7   // %Y
+#define SEG_MONTH     8   // %m
+#define SEG_DAY       9   // %d
+#define SEG_HOUR     10   // %H
+#define SEG_MINUTE   11   // %M
+#define SEG_SECOND   12   // %S
+#define SEG_EPOCH    13   // %s
+
+#define SEG_MAX_FAST_LEN 32  // longest output of any fast segment
+#define STRFTIME_SENTINEL '\001'
+
+typedef struct time_seg {
+    int kind;
+    int width;          // digits for %N
+    const char *text;   // literal text, or strftime chunk (also fallback)
+    size_t len;         // literal length
+} time_seg;
+
+typedef struct lstime_time_prog {
+    char *format;       // copy of the source format, the cache key
+    time_seg *segs;
+    size_t num_segs;
+    char *text;
+} time_prog;
+
+static int fast_seg_kind(char spec_letter) {
+    switch (spec_letter) {
+        case 'z': return SEG_Z;
+        case 'F': return SEG_DATE;
+        case 'T': return SEG_TIME;
+        case 'Y': return SEG_YEAR;
+        case 'm': return SEG_MONTH;
+        case 'd': return SEG_DAY;
+        case 'H': return SEG_HOUR;
+        case 'M': return SEG_MINUTE;
+        case 'S': return SEG_SECOND;
+        case 's': return SEG_EPOCH;
+        default:  return SEG_STRFTIME;
+    }
+}
+
+static void free_time_prog(time_prog *prog) {
+    if (prog != NULL) {
+        free(prog->format);
+        free(prog->segs);
+        free(prog->text);
+        free(prog);
     }
 }
 
+static time_prog *compile_time_format(const char *time_format) {
+    size_t fmt_len = strlen(time_format);
+    time_prog *prog = calloc(1, sizeof(time_prog));
+    if (prog != NULL) {
+        prog->format = strdup(time_format);
+        prog->segs = malloc((fmt_len + 1) * sizeof(time_seg));
+        prog->text = malloc(2 * fmt_len + 2);
+    }
+    if (prog == NULL || prog->format == NULL ||
+        prog->segs == NULL || prog->text == NULL) {
+        err("time format out of memory: %s", strerror(errno));
+        exit(45);
+    }
 
-static char *preprocess_time_format(const char *time_format,
-                                    long nsec,
-                                    struct tm *tm) {
-    static char buf[MAX_TIME_LEN];
-    char *buf_ptr = buf;
-    char *buf_end = buf + sizeof(buf) - 1;
+    char *text_ptr = prog->text;
+    time_seg *open_seg = NULL;  // literal or strftime seg still growing
     const char *ptr = time_format;
 
     while (*ptr != '\0') {
-        if (*ptr == '%') {
-            const char *spec_beg = ptr++;
-            int extended_spec_found = 0;
-            do { // posit we will eventually find a valid extended spec
-                // flags
-                while (*ptr != '\0' && strchr("_-0^#", *ptr) != NULL) {
-                    ++ptr;
-                }
-                if (*ptr == '\0') {
-                    break;
-                }
+        if (*ptr != '%') {
+            if (open_seg != NULL && open_seg->kind == SEG_STRFTIME) {
+                text_ptr -= 2;  // literal joins the chunk, before sentinel
+                *text_ptr++ = *ptr++;
+                *text_ptr++ = STRFTIME_SENTINEL;
+                *text_ptr++ = '\0';
+                continue;
+            }
+            if (open_seg == NULL) {
+                open_seg = &prog->segs[prog->num_segs++];
+                open_seg->kind = SEG_LITERAL;
+                open_seg->text = text_ptr;
+                open_seg->len = 0;
+            }
+            *text_ptr++ = *ptr++;
+            ++open_seg->len;
+            continue;
+        }
 
-                // width
-                const char *width_beg = ptr;
-                while (*ptr != '\0' && isdigit((unsigned char) *ptr)) {
-                    ++ptr;
-                }
-                const char *width_end = ptr;
-                if (*ptr == '\0') {
-                    break;
-                }
+        const char *spec_beg = ptr++;
+        int kind = SEG_STRFTIME;
+        int nano_width = 9;  // default & max
+        do { // posit we will eventually find a valid extended spec
+            // flags
+            while (*ptr != '\0' && strchr("_-0^#", *ptr) != NULL) {
+                ++ptr;
+            }
+            if (*ptr == '\0') {
+                break;
+            }
 
-                // modifier
-                if (*ptr == 'E' || *ptr == 'O') {
-                    ++ptr;
-                }
-                if (*ptr == '\0') {
-                    break;
-                }
+            // width
+            const char *width_beg = ptr;
+            while (*ptr != '\0' && isdigit((unsigned char) *ptr)) {
+                ++ptr;
+            }
+            const char *width_end = ptr;
+            if (*ptr == '\0') {
+                break;
+            }
 
-                // spec letter
-                // if (!(isalpha((unsigned char) *ptr) || *ptr == '%' || *ptr == '+')) {
-                //     break;
-                // }
-
-                const char spec_letter = *ptr++;
-                if (spec_letter == 'N') {
-                    // confirmed we have an extended spec
-                    extended_spec_found = 1;
-                    int nano_width = 9;  // default & max
-                    if (width_beg + 1 == width_end) {
-                        nano_width = *width_beg - '0';
-                    }
-                    // fprintf(stderr, "nano_width = %d\n", nano_width);
-                    if (buf_ptr > buf_end - 10) {
-                        err("preprocess_time_format: buf len %zu exceeded",
-                            sizeof(buf));
-                        exit(16);
-                    }
-                    size_t rc = snprintf(buf_ptr, 11, "%09ld", nsec);
-                    if (rc != 9) {
-                        err("preprocess_time_format: internal logic error");
-                        exit(21);
-                    }
-                    buf_ptr += nano_width;
-                } else if (spec_letter == ':' && *ptr == 'z') {
-                    char zbuf[12];
-                    // confirmed we have an extended spec
-                    extended_spec_found = 1;
-                    ++ptr;
-                    int len = strftime(zbuf, sizeof(zbuf), "%z", tm);
-                    if (len == 0) {
-                        err("strftime: zbuf: len %zu exhausted", sizeof(zbuf));
-                        exit(11);
-                    } else if (len != 5) {
-                        err("strftime: unexpected result: len=%d", len);
-                        exit(31);
-                    }
-                    if (buf_ptr > buf_end - 7) {
-                        err("preprocess_time_format: exceeded buf len %zu",
-                            sizeof(buf));
-                        exit(18);
-                    }
-                    // now copy chars and insert colon
-                    *buf_ptr++ = zbuf[0];
-                    *buf_ptr++ = zbuf[1];
-                    *buf_ptr++ = zbuf[2];
-                    *buf_ptr++ = ':';
-                    *buf_ptr++ = zbuf[3];
-                    *buf_ptr++ = zbuf[4];
-                }
-            } while (0);
-
-            if (!extended_spec_found) {
-                // native strftime spec or something unparseable
-                if (buf_ptr > buf_end - (ptr - spec_beg)) {
-                    err("preprocess_time_format: exceeded buf len %zu",
-                          sizeof(buf));
-                    exit(17);
-                }
-                while (spec_beg < ptr) {
-                    *buf_ptr++ = *spec_beg++;
+            // modifier
+            if (*ptr == 'E' || *ptr == 'O') {
+                ++ptr;
+            }
+            if (*ptr == '\0') {
+                break;
+            }
+
+            const char spec_letter = *ptr++;
+            if (spec_letter == 'N') {
+                kind = SEG_NSEC;
+                if (width_beg + 1 == width_end) {
+                    nano_width = *width_beg - '0';
                 }
+            } else if (spec_letter == ':' && *ptr == 'z') {
+                kind = SEG_COLON_Z;
+                ++ptr;
+            } else if (spec_letter == '%' && ptr - spec_beg == 2) {
+                kind = SEG_LITERAL;
+            } else if (ptr - spec_beg == 2) {  // no flags, width or modifier
+                kind = fast_seg_kind(spec_letter);
             }
+        } while (0);
 
-        } else { // plain literal char
-            if (buf_ptr > buf_end - 1) {
-                err("preprocess_time_format: exceeded buf len %zu",
-                    sizeof(buf));
-                exit(20);
+        if (kind == SEG_LITERAL) {  // "%%"
+            if (open_seg != NULL && open_seg->kind == SEG_STRFTIME) {
+                text_ptr -= 2;  // stays escaped inside the chunk
+                *text_ptr++ = '%';
+                *text_ptr++ = '%';
+                *text_ptr++ = STRFTIME_SENTINEL;
+                *text_ptr++ = '\0';
+                continue;
             }
-            *buf_ptr++ = *ptr++;
+            if (open_seg == NULL) {
+                open_seg = &prog->segs[prog->num_segs++];
+                open_seg->kind = SEG_LITERAL;
+                open_seg->text = text_ptr;
+                open_seg->len = 0;
+            }
+            *text_ptr++ = '%';
+            ++open_seg->len;
+            continue;
         }
+
+        if (kind == SEG_STRFTIME && open_seg != NULL &&
+            open_seg->kind == SEG_STRFTIME) {
+            text_ptr -= 2;  // extend the previous chunk
+        } else {
+            time_seg *seg = &prog->segs[prog->num_segs++];
+            seg->kind = kind;
+            seg->width = nano_width;
+            seg->text = text_ptr;
+            seg->len = 0;
+            open_seg = (kind == SEG_STRFTIME) ? seg : NULL;
+        }
+        // every non-literal seg keeps its spec as a strftime chunk
+        while (spec_beg < ptr) {
+            *text_ptr++ = *spec_beg++;
+        }
+        *text_ptr++ = STRFTIME_SENTINEL;
+        *text_ptr++ = '\0';
+    }
+    return prog;
+}
+
+// the compiled time format, kept in ctx while the format stays the same
+static const time_prog *get_time_prog(lstime_format_ctx *ctx,
+                                      const char *time_format) {
+    if (ctx->time_prog == NULL ||
+        strcmp(ctx->time_prog->format, time_format) != 0) {
+        free_time_prog(ctx->time_prog);
+        ctx->time_prog = compile_time_format(time_format);
     }
+    return ctx->time_prog;
+}
 
-    *buf_ptr = '\0';
-    return buf;
+static inline char *put2(char *p, int v) {
+    p[0] = '0' + v / 10;
+    p[1] = '0' + v % 10;
+    return p + 2;
 }
 
+static inline char *put4(char *p, int v) {
+    p = put2(p, v / 100);
+    return put2(p, v % 100);
+}
 
-const char *lstime_format_timestamp(timespec ts,
-                                    const char *time_format,
-                                    bool format_time_as_utc) {
-    static char buffer[MAX_TIME_LEN];
+static char *put_int64(char *p, int64_t v) {
+    char tmp[24];
+    char *t = tmp + sizeof(tmp);
+    uint64_t u = (v < 0) ? -(uint64_t) v : (uint64_t) v;
+    do {
+        *--t = '0' + u % 10;
+        u /= 10;
+    } while (u != 0);
+    if (v < 0) {
+        *--t = '-';
+    }
+    size_t n = tmp + sizeof(tmp) - t;
+    memcpy(p, t, n);
+    return p + n;
+}
+
+// same output as strftime's %z, minutes truncated as glibc does
+static char *put_utc_offset(char *p, long gmtoff, bool colon) {
+    *p++ = (gmtoff < 0) ? '-' : '+';
+    long mins = ((gmtoff < 0) ? -gmtoff : gmtoff) / 60;
+    if (mins / 60 > 99) {
+        p = put_int64(p, mins / 60);
+    } else {
+        p = put2(p, mins / 60);
+    }
+    if (colon) {
+        *p++ = ':';
+    }
+    return put2(p, mins % 60);
+}
+
+static size_t run_strftime(char *buf, size_t cap, const char *chunk,
+                           const struct tm *tm) {
+    size_t n = strftime(buf, cap, chunk, tm);
+    if (n == 0) {
+        // the sentinel may be all that did not fit
+        char tmp[MAX_TIME_LEN + 1];
+        n = strftime(tmp, sizeof(tmp), chunk, tm);
+        if (n == 0 || n > cap) {
+            err("strftime: buffer: len %d exhausted", MAX_TIME_LEN);
+            exit(23);
+        }
+        memcpy(buf, tmp, n - 1);
+    }
+    return n - 1;  // drop the sentinel
+}
+
+static size_t run_time_prog(const time_prog *prog,
+                            char *buf,
+                            size_t cap,
+                            timespec ts,
+                            const struct tm *tm) {
+    char *p = buf;
+    char *end = buf + cap - 1;
+    char nsec_digits[12];
+    int year = tm->tm_year + 1900;
+    bool plain_year = year >= 1000 && year <= 9999;
+
+    for (size_t i = 0; i < prog->num_segs; ++i) {
+        const time_seg *seg = &prog->segs[i];
+        if (seg->kind == SEG_LITERAL) {
+            if ((size_t)(end - p) < seg->len) {
+                err("strftime: buffer: len %d exhausted", MAX_TIME_LEN);
+                exit(23);
+            }
+            memcpy(p, seg->text, seg->len);
+            p += seg->len;
+            continue;
+        }
+        if (seg->kind != SEG_STRFTIME && end - p < SEG_MAX_FAST_LEN) {
+            // strftime chunks check the room left themselves
+            err("strftime: buffer: len %d exhausted", MAX_TIME_LEN);
+            exit(23);
+        }
+        switch (seg->kind) {
+            case SEG_NSEC:
+                snprintf(nsec_digits, sizeof(nsec_digits), "%09ld", ts.tv_nsec);
+                memcpy(p, nsec_digits, seg->width);
+                p += seg->width;
+                break;
+            case SEG_COLON_Z:
+                p = put_utc_offset(p, tm->tm_gmtoff, true);
+                break;
+            case SEG_Z:
+                p = put_utc_offset(p, tm->tm_gmtoff, false);
+                break;
+            case SEG_DATE:
+                if (!plain_year) {
+                    p += run_strftime(p, end - p + 1, seg->text, tm);
+                    break;
+                }
+                p = put4(p, year);
+                *p++ = '-';
+                p = put2(p, tm->tm_mon + 1);
+                *p++ = '-';
+                p = put2(p, tm->tm_mday);
+                break;
+            case SEG_TIME:
+                p = put2(p, tm->tm_hour);
+                *p++ = ':';
+                p = put2(p, tm->tm_min);
+                *p++ = ':';
+                p = put2(p, tm->tm_sec);
+                break;
+            case SEG_YEAR:
+                if (!plain_year) {
+                    p += run_strftime(p, end - p + 1, seg->text, tm);
+                    break;
+                }
+                p = put4(p, year);
+                break;
+            case SEG_MONTH:
+                p = put2(p, tm->tm_mon + 1);
+                break;
+            case SEG_DAY:
+                p = put2(p, tm->tm_mday);
+                break;
+            case SEG_HOUR:
+                p = put2(p, tm->tm_hour);
+                break;
+            case SEG_MINUTE:
+                p = put2(p, tm->tm_min);
+                break;
+            case SEG_SECOND:
+                p = put2(p, tm->tm_sec);
+                break;
+            case SEG_EPOCH:
+                // not strftime's %s, which runs mktime on the broken down
+                // time and so depends on the time zone
+                p = put_int64(p, ts.tv_sec);
+                break;
+            default:
+                p += run_strftime(p, end - p + 1, seg->text, tm);
+                break;
+        }
+    }
+    *p = '\0';
+    return p - buf;
+}
+
+
+// buffers for lstime_format_timestamp and lstime_format_path, which keep
+// their old interface (results overwritten by the next call); the buffers
+// are per thread, like the caches above
+static _Thread_local lstime_format_ctx thread_ctx;
+
+lstime_format_ctx *lstime_thread_format_ctx(void) {
+    return &thread_ctx;
+}
+
+void lstime_format_ctx_free(lstime_format_ctx *ctx) {
+    free(ctx->quoted_buf);
+    ctx->quoted_buf = NULL;
+    ctx->quoted_cap = 0;
+    free_time_prog(ctx->time_prog);
+    ctx->time_prog = NULL;
+}
+
+const char *lstime_format_timestamp_r(lstime_format_ctx *ctx,
+                                      timespec ts,
+                                      const char *time_format,
+                                      bool format_time_as_utc) {
     struct tm tm;
 
     if (! HAS_TIMESPEC(&ts)) {
@@ -151,12 +524,19 @@ const char *lstime_format_timestamp(timespec ts,
     }
     tm_from_timespec(&tm, ts, format_time_as_utc);
 
-    const char *tmpfmt = preprocess_time_format(time_format, ts.tv_nsec, &tm);
-    int len = strftime(buffer, sizeof(buffer), tmpfmt, &tm);
+    const time_prog *prog = get_time_prog(ctx, time_format);
+    size_t len = run_time_prog(prog, ctx->time_buf, sizeof(ctx->time_buf),
+                               ts, &tm);
     if (len == 0) {
-        err("strftime: buffer: len %zu exhausted", sizeof(buffer));
+        err("strftime: buffer: len %zu exhausted", sizeof(ctx->time_buf));
         exit(23);
     }
-    return buffer;
+    return ctx->time_buf;
 }
 
+const char *lstime_format_timestamp(timespec ts,
+                                    const char *time_format,
+                                    bool format_time_as_utc) {
+    return lstime_format_timestamp_r(&thread_ctx, ts, time_format,
+                                     format_time_as_utc);
+}
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "lstime_private.h"
 #include "lstime_tests.h"
@@ -60,6 +61,256 @@ static bool test_timezone() {
     return true;
 }
 
+// the cached/arithmetic conversion must agree with the C library,
+// including across DST transitions
+static bool compare_with_libc(const char *tz, bool utc) {
+    const char *fmt = "%F %T %z %Z %a %j %U";
+    char expected[MAX_TIME_LEN];
+    setenv("TZ", tz, 1);
+    tzset();
+    lstime_tz_cache_reset();
+    bool same = true;
+    for (time_t t = -4000000000; t < 4000000000 && same; t += 3599 * 7 + 13) {
+        struct tm tm;
+        if (utc) {
+            gmtime_r(&t, &tm);
+        } else {
+            localtime_r(&t, &tm);
+        }
+        strftime(expected, sizeof(expected), fmt, &tm);
+        timespec ts;
+        ts.tv_sec = t;
+        ts.tv_nsec = 0;
+        same = strcmp(lstime_format_timestamp(ts, fmt, utc), expected) == 0;
+    }
+    setenv("TZ", "UTC+02:00", 1);
+    tzset();
+    lstime_tz_cache_reset();
+    return same;
+}
+
+static bool test_tz_cache() {
+    du_assert_true(compare_with_libc("EST5EDT,M3.2.0,M11.1.0", false),
+                   "local time with DST rules");
+    du_assert_true(compare_with_libc("EST5EDT,M3.2.0,M11.1.0", true),
+                   "UTC time");
+    du_assert_true(compare_with_libc("Europe/Dublin", false),
+                   "local time with tzdata history");
+    du_assert_true(compare_with_libc("right/UTC", false),
+                   "local time with leap seconds");
+    du_assert_true(compare_with_libc("right/UTC", true),
+                   "UTC time with leap seconds");
+    du_assert_true(compare_with_libc("right/America/New_York", false),
+                   "local time with DST and leap seconds");
+    return true;
+}
+
+// the strftime format giving the same output as fmt: %N and %:z (which
+// strftime lacks) are expanded into literal text beforehand
+static void reference_format(char *out, const char *fmt, const struct tm *tm,
+                             long nsec) {
+    char digits[16];
+    snprintf(digits, sizeof(digits), "%09ld", nsec);
+    while (*fmt != '\0') {
+        if (fmt[0] == '%' && fmt[1] == '%') {
+            *out++ = *fmt++;
+            *out++ = *fmt++;
+        } else if (fmt[0] == '%' && fmt[1] == ':' && fmt[2] == 'z') {
+            char z[16];
+            size_t n = strftime(z, sizeof(z), "%z", tm);
+            memcpy(out, z, n - 2);
+            out[n - 2] = ':';
+            memcpy(out + n - 1, z + n - 2, 2);
+            out += n + 1;
+            fmt += 3;
+        } else if (fmt[0] == '%' && fmt[1] == 'N') {
+            out = stpcpy(out, digits);
+            fmt += 2;
+        } else if (fmt[0] == '%' && fmt[1] >= '1' && fmt[1] <= '9' &&
+                   fmt[2] == 'N') {
+            memcpy(out, digits, fmt[1] - '0');
+            out += fmt[1] - '0';
+            fmt += 3;
+        } else {
+            *out++ = *fmt++;
+        }
+    }
+    *out = '\0';
+}
+
+// every fast segment (alone and mixed with strftime chunks and literals)
+// against plain strftime
+static bool compare_fast_segs(const char *tz, bool utc) {
+    static const char *fmts[] = {
+        "%F", "%T", "%Y", "%m", "%d", "%H", "%M", "%S", "%z", "%:z", "%s",
+        "%N", "%1N", "%3N", "%6N", "%9N", "%%", "%%N %%:z %%F",
+        "%FT%T.%N%:z",
+        "%Y-%m-%d %H:%M:%S %z",
+        "%a %F %b %T %Z",
+        "%e/%Y/%j %s.%3N",
+        "%-m/%_d %Y%%%H %10Y",
+        "%EY %OH:%M",
+        "100%% %Y%m%dT%H%M%S%z",
+    };
+    static const time_t secs[] = {
+        0, 1, -2, 59, -86400, -86401, 951782400, 1700000000, 2147483648,
+        -2208988800,      // 1900
+        -30610224000,     // 1000
+        -30610224001,     // 999
+        -62135596800,     // 1
+        -62167219201,     // -1
+        253402300799,     // 9999
+        253402300800,     // 10000
+        1099511627776,    // past the arithmetic range
+        -1099511627777,
+    };
+    static const long nsecs[] = { 0, 1, 123456789, 999999999 };
+    char ref_fmt[256];
+    char expected[MAX_TIME_LEN];
+    setenv("TZ", tz, 1);
+    tzset();
+    lstime_tz_cache_reset();
+    bool same = true;
+    for (size_t f = 0; f < sizeof(fmts) / sizeof(fmts[0]) && same; ++f) {
+        for (size_t i = 0; i < sizeof(secs) / sizeof(secs[0]) && same; ++i) {
+            struct tm tm;
+            if (utc) {
+                gmtime_r(&secs[i], &tm);
+            } else {
+                localtime_r(&secs[i], &tm);
+            }
+            timespec ts;
+            ts.tv_sec = secs[i];
+            ts.tv_nsec = nsecs[i % 4];
+            reference_format(ref_fmt, fmts[f], &tm, ts.tv_nsec);
+            strftime(expected, sizeof(expected), ref_fmt, &tm);
+            const char *rc = lstime_format_timestamp(ts, fmts[f], utc);
+            same = strcmp(rc, expected) == 0;
+            if (!same) {
+                printf("TZ=%s %s at %lld: \"%s\", strftime \"%s\"\n", tz,
+                       fmts[f], (long long) secs[i], rc, expected);
+            }
+        }
+    }
+    setenv("TZ", "UTC+02:00", 1);
+    tzset();
+    lstime_tz_cache_reset();
+    return same;
+}
+
+static bool test_fast_segs() {
+    du_assert_true(compare_fast_segs("UTC0", true), "UTC");
+    du_assert_true(compare_fast_segs("EST5EDT,M3.2.0,M11.1.0", false),
+                   "local time with DST rules");
+    du_assert_true(compare_fast_segs("America/St_Johns", false),
+                   "half hour offset, negative");
+    du_assert_true(compare_fast_segs("Asia/Kolkata", false),
+                   "half hour offset, positive");
+    du_assert_true(compare_fast_segs("Asia/Kathmandu", false),
+                   "45 minute offset");
+    du_assert_true(compare_fast_segs("right/UTC", true),
+                   "UTC with leap seconds");
+    du_assert_true(compare_fast_segs("right/UTC", false),
+                   "local time with leap seconds");
+    return true;
+}
+
+// %s is the epoch seconds, in UTC too (strftime's mktime would add the
+// local offset)
+static bool test_epoch_secs() {
+    timespec ts;
+    ts.tv_sec = 1700000000;
+    ts.tv_nsec = 0;
+    du_assert_str_eq(lstime_format_timestamp(ts, "%s", true), "1700000000",
+                     "UTC");
+    du_assert_str_eq(lstime_format_timestamp(ts, "%s", false), "1700000000",
+                     "local time");
+    return true;
+}
+
+// strftime chunks may fill the buffer up to its last byte
+static bool test_long_format() {
+    char fmt[MAX_TIME_LEN];
+    char expected[MAX_TIME_LEN];
+    timespec ts;
+    ts.tv_sec = 0;
+    ts.tv_nsec = 0;
+    memset(fmt, 'x', MAX_TIME_LEN - 4);
+    strcpy(fmt + MAX_TIME_LEN - 4, "%a");
+    memset(expected, 'x', MAX_TIME_LEN - 4);
+    strcpy(expected + MAX_TIME_LEN - 4, "Thu");
+    du_assert_str_eq(lstime_format_timestamp(ts, fmt, true), expected,
+                     "chunk ending at the last byte");
+    strcpy(fmt + MAX_TIME_LEN - 24, "%a %b");
+    strcpy(expected + MAX_TIME_LEN - 24, "Thu Jan");
+    du_assert_str_eq(lstime_format_timestamp(ts, fmt, true), expected,
+                     "chunk near the end");
+    return true;
+}
+
+static bool test_format_timestamp_r() {
+    timespec ts;
+    ts.tv_sec = 0;
+    ts.tv_nsec = 0;
+    lstime_format_ctx ctx = { 0 };
+    const char *rc1 = lstime_format_timestamp_r(&ctx, ts, "%F", true);
+    const char *rc2 = lstime_format_timestamp(ts, "%T", true);
+    du_assert_str_eq(rc1, "1970-01-01", "own ctx");
+    du_assert_str_eq(rc2, "00:00:00", "thread ctx");
+    lstime_format_ctx_free(&ctx);
+    return true;
+}
+
+// each thread formats with its own ctx, and its own time format (compiled
+// per thread); a path and a time from one ctx must not overwrite each other
+typedef struct format_job {
+    const char *path;
+    const char *quoted;
+    const char *fmt;
+    const char *time;
+    bool same;
+} format_job;
+
+static void *format_worker(void *arg) {
+    format_job *job = arg;
+    lstime_format_ctx ctx = { 0 };
+    timespec ts;
+    ts.tv_sec = 2147483648;
+    ts.tv_nsec = 123456789;
+    job->same = true;
+    for (int i = 0; i < 20000 && job->same; ++i) {
+        const char *quoted = lstime_format_path_r(&ctx, job->path, true, false);
+        const char *time = lstime_format_timestamp_r(&ctx, ts, job->fmt, true);
+        job->same = strcmp(quoted, job->quoted) == 0 &&
+            strcmp(time, job->time) == 0;
+    }
+    lstime_format_ctx_free(&ctx);
+    return NULL;
+}
+
+static bool test_format_threads() {
+    format_job jobs[] = {
+        { "a b", "'a b'", "%FT%T", "2038-01-19T03:14:08", false },
+        { "caf\xC3\xA9", "$'caf\\u00E9'", "%T.%3N", "03:14:08.123", false },
+        { "\xFF\x01", "$'\\xFF\\x01'", "%a %b %e %Y", "Tue Jan 19 2038", false },
+        { "it's", "$'it\\'s'", "%H%M%S%:z", "031408+00:00", false },
+    };
+    pthread_t tids[4];
+    int started = 0;
+    while (started < 4 &&
+           pthread_create(&tids[started], NULL, format_worker, &jobs[started]) == 0) {
+        ++started;
+    }
+    for (int i = 0; i < started; ++i) {
+        pthread_join(tids[i], NULL);
+    }
+    du_assert_int_eq(started, 4, "pthread_create");
+    for (int i = 0; i < 4; ++i) {
+        du_assert_true(jobs[i].same, jobs[i].fmt);
+    }
+    return true;
+}
+
 
 static void build_info_by_time(arr_wrapper *list, int type, long sec, long nsec) {
     timespec ts;
@@ -83,10 +334,16 @@ static void build_info_by_time(arr_wrapper *list, int type, long sec, long nsec)
     add_info_to_list(list, &info);
 }
 
+static lstime_info item(const arr_wrapper *list, size_t i) {
+    lstime_info info;
+    lstime_list_get(list, i, &info);
+    return info;
+}
+
 static void build_info_by_path(arr_wrapper *list, const char *path) {
     lstime_info info;
     memset(&info, 0, sizeof(info));
-    info.path = strdup(path);
+    info.path = path;
     add_info_to_list(list, &info);
 }
 
@@ -106,10 +363,10 @@ static bool test_fwd_m_sort() {
 
     lstime_sort_list(&list, &opts);
 
-    du_assert_int_eq(list.arr[0].mtime.tv_nsec, 4, " ");
-    du_assert_int_eq(list.arr[1].mtime.tv_nsec, 3, " ");
-    du_assert_int_eq(list.arr[2].mtime.tv_nsec, 2, " ");
-    du_assert_int_eq(list.arr[3].mtime.tv_nsec, 1, " ");
+    du_assert_int_eq(item(&list, 0).mtime.tv_nsec, 4, " ");
+    du_assert_int_eq(item(&list, 1).mtime.tv_nsec, 3, " ");
+    du_assert_int_eq(item(&list, 2).mtime.tv_nsec, 2, " ");
+    du_assert_int_eq(item(&list, 3).mtime.tv_nsec, 1, " ");
     return true;
 }
 
@@ -128,10 +385,10 @@ static bool test_rev_a_sort() {
 
     lstime_sort_list(&list, &opts);
 
-    du_assert_int_eq(list.arr[0].atime.tv_sec, 1, " ");
-    du_assert_int_eq(list.arr[1].atime.tv_sec, 2, " ");
-    du_assert_int_eq(list.arr[2].atime.tv_sec, 3, " ");
-    du_assert_int_eq(list.arr[3].atime.tv_sec, 4, " ");
+    du_assert_int_eq(item(&list, 0).atime.tv_sec, 1, " ");
+    du_assert_int_eq(item(&list, 1).atime.tv_sec, 2, " ");
+    du_assert_int_eq(item(&list, 2).atime.tv_sec, 3, " ");
+    du_assert_int_eq(item(&list, 3).atime.tv_sec, 4, " ");
     return true;
 }
 
@@ -151,10 +408,10 @@ static bool test_fwd_p_sort() {
     lstime_sort_list(&list, &opts);
     // lstime_output_list(stderr, &list, &opts);
 
-    du_assert_str_eq(list.arr[0].path, "aaa", " ");
-    du_assert_str_eq(list.arr[1].path, "bbb", " ");
-    du_assert_str_eq(list.arr[2].path, "ccc", " ");
-    du_assert_str_eq(list.arr[3].path, "ddd", " ");
+    du_assert_str_eq(item(&list, 0).path, "aaa", " ");
+    du_assert_str_eq(item(&list, 1).path, "bbb", " ");
+    du_assert_str_eq(item(&list, 2).path, "ccc", " ");
+    du_assert_str_eq(item(&list, 3).path, "ddd", " ");
     return true;
 }
 
@@ -174,14 +431,354 @@ static bool test_rev_p_sort() {
     lstime_sort_list(&list, &opts);
     // lstime_output_list(stderr, &list, &opts);
 
-    du_assert_str_eq(list.arr[0].path, "ddd", " ");
-    du_assert_str_eq(list.arr[1].path, "ccc", " ");
-    du_assert_str_eq(list.arr[2].path, "bbb", " ");
-    du_assert_str_eq(list.arr[3].path, "aaa", " ");
+    du_assert_str_eq(item(&list, 0).path, "ddd", " ");
+    du_assert_str_eq(item(&list, 1).path, "ccc", " ");
+    du_assert_str_eq(item(&list, 2).path, "bbb", " ");
+    du_assert_str_eq(item(&list, 3).path, "aaa", " ");
     return true;
 }
 
+static bool ts_before(const timespec *t1, const timespec *t2) {
+    return t1->tv_sec < t2->tv_sec ||
+        (t1->tv_sec == t2->tv_sec && t1->tv_nsec < t2->tv_nsec);
+}
+
+// > 0 if a sorts after b (without --reverse)
+typedef int (*item_cmp_fn)(const lstime_info *a, const lstime_info *b);
+
+static int cmp_ctime(const lstime_info *a, const lstime_info *b) {
+    return ts_before(&a->ctime, &b->ctime) - ts_before(&b->ctime, &a->ctime);
+}
+
+static int cmp_path(const lstime_info *a, const lstime_info *b) {
+    return strcmp(a->path, b->path);
+}
+
+// true if the list is in sort order by cmp, with equal items in arrival
+// order (kept in mtime by the tests that check it, else all 0)
+static bool check_sorted(const arr_wrapper *list,
+                         const lstime_options *opts,
+                         item_cmp_fn cmp) {
+    for (size_t i = 1; i < list->num_elems; ++i) {
+        lstime_info prev = item(list, i - 1);
+        lstime_info cur = item(list, i);
+        int rc = cmp(&prev, &cur);
+        if ((opts->reverse ? -rc : rc) > 0 ||
+            (rc == 0 && prev.mtime.tv_sec > cur.mtime.tv_sec)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// long enough lists take the radix sort, including N/A and negative times
+static bool test_radix_sort(void) {
+    for (int reverse = 0; reverse <= 1; ++reverse) {
+        arr_wrapper list;
+        memset(&list, 0, sizeof(list));
+        lstime_options opts;
+        lstime_set_option_defaults(&opts);
+        opts.reverse = reverse;
+        opts.sort_field = 'c';
+
+        unsigned seed = 12345;
+        for (int i = 0; i < 5000; ++i) {
+            seed = seed * 1103515245 + 12345;
+            long sec = (long) (seed >> 8) % 2000000 - 1000000;
+            long nsec = (long) (seed % 1000) * 999999;
+            if (i % 97 == 0) {
+                sec = -1;   // N/A
+                nsec = -1;
+            } else if (i % 89 == 0) {
+                sec = -1;
+                nsec = 0;
+            }
+            build_info_by_time(&list, 'c', sec, nsec);
+        }
+        lstime_sort_list(&list, &opts);
+
+        du_assert_int_eq(list.num_elems, 5000, "radix sort keeps all items");
+        du_assert_true(check_sorted(&list, &opts, cmp_ctime), "radix sort order");
+        lstime_list_free(&list);
+    }
+    return true;
+}
 
+// long lists sort on several threads; mtime records the arrival order.
+// 64K items is just enough (PARALLEL_MIN_ELEMS) for 3 and 4 threads.
+static bool test_parallel_sort(void) {
+    const int num_items = 64 * 1024;
+    for (int jobs = 3; jobs <= 4; ++jobs) {
+        for (int field = 0; field <= 1; ++field) {
+            arr_wrapper list;
+            memset(&list, 0, sizeof(list));
+            lstime_options opts;
+            lstime_set_option_defaults(&opts);
+            opts.jobs = jobs;
+            opts.reverse = (jobs == 4);
+            opts.sort_field = field ? 'p' : 'c';
+
+            char path[64];
+            lstime_info info;
+            memset(&info, 0, sizeof(info));
+            info.path = path;
+            unsigned seed = 4242;
+            for (int i = 0; i < num_items; ++i) {
+                seed = seed * 1103515245 + 12345;
+                unsigned r = seed >> 8;
+                snprintf(path, sizeof(path), "/var/dir%u/f%u", r % 13, (r >> 4) % 500);
+                info.mtime.tv_sec = i;
+                info.ctime.tv_sec = (r >> 6) % 1000;
+                info.ctime.tv_nsec = r % 3;
+                add_info_to_list(&list, &info);
+            }
+            lstime_sort_list(&list, &opts);
+
+            du_assert_int_eq(list.num_elems, num_items, "parallel sort keeps all items");
+            du_assert_true(check_sorted(&list, &opts, field ? cmp_path : cmp_ctime),
+                           "parallel sort order");
+            lstime_list_free(&list);
+        }
+    }
+    return true;
+}
+
+static int cmp_atime(const lstime_info *a, const lstime_info *b) {
+    return ts_before(&a->atime, &b->atime) - ts_before(&b->atime, &a->atime);
+}
+
+// presorted inputs take the run merge: ascending, descending, and
+// ascending runs with a few items out of place; mtime is arrival order.
+// Paths are sorted both bytewise and by collation key prefixes (what a
+// real locale uses, forced here since only C locales may be installed).
+static bool test_presorted_sort(void) {
+    for (int shape = 0; shape < 3; ++shape) {
+        for (int field = 0; field <= 2; ++field) {
+            arr_wrapper list;
+            memset(&list, 0, sizeof(list));
+            lstime_options opts;
+            lstime_set_option_defaults(&opts);
+            opts.sort_field = field ? 'p' : 'a';
+            lstime_collate_override(field == 2 ? 0 : -1);
+
+            char path[64];
+            lstime_info info;
+            memset(&info, 0, sizeof(info));
+            info.path = path;
+            for (int i = 0; i < 20000; ++i) {
+                int v = (shape == 1) ? 20000 - i : i;
+                if (shape == 2 && i % 1000 == 999) {
+                    v = 7 * i % 20000;
+                }
+                v /= 2;   // pairs of equal keys
+                if (field == 2) {   // keys differ within the prefix
+                    snprintf(path, sizeof(path), "%05d/some/dir", v);
+                } else {
+                    snprintf(path, sizeof(path), "/some/dir/%08d", field ? v : 0);
+                }
+                info.atime.tv_sec = field ? 0 : v;
+                info.mtime.tv_sec = i;
+                add_info_to_list(&list, &info);
+            }
+            lstime_sort_list(&list, &opts);
+            lstime_collate_override(-1);
+
+            du_assert_int_eq(list.num_elems, 20000, "presorted sort keeps all items");
+            du_assert_true(check_sorted(&list, &opts, field ? cmp_path : cmp_atime),
+                           "presorted sort order");
+            lstime_list_free(&list);
+        }
+    }
+    return true;
+}
+
+// only the requested fields are kept; the rest read back as N/A
+static bool test_list_fields(void) {
+    arr_wrapper list;
+    memset(&list, 0, sizeof(list));
+    list.fields = 1u << 0;  // mtime
+    build_info_by_time(&list, 'm', -5, 999999999);
+    lstime_info info;
+    memset(&info, 0, sizeof(info));
+    info.path = "empty";
+    SET_TIMESPEC_EMPTY(&info.mtime);
+    add_info_to_list(&list, &info);
+
+    du_assert_int_eq(list.secs[1] == NULL, true, "atime not kept");
+    du_assert_int_eq(item(&list, 0).mtime.tv_sec, -5, " ");
+    du_assert_int_eq(item(&list, 0).mtime.tv_nsec, 999999999, " ");
+    du_assert_int_eq(item(&list, 0).atime.tv_nsec, -1, "atime is N/A");
+    du_assert_int_eq(item(&list, 1).mtime.tv_sec, -1, "N/A mtime");
+    du_assert_int_eq(item(&list, 1).mtime.tv_nsec, -1, "N/A mtime");
+    du_assert_str_eq(item(&list, 1).path, "empty", " ");
+    lstime_list_free(&list);
+    return true;
+}
+
+// long shared prefixes and duplicates; mtime records the arrival order
+static bool test_path_sort_prefixes(void) {
+    for (int reverse = 0; reverse <= 1; ++reverse) {
+        arr_wrapper list;
+        memset(&list, 0, sizeof(list));
+        lstime_options opts;
+        lstime_set_option_defaults(&opts);
+        opts.reverse = reverse;
+        opts.sort_field = 'p';
+
+        char path[128];
+        lstime_info info;
+        memset(&info, 0, sizeof(info));
+        info.path = path;
+        unsigned seed = 777;
+        for (int i = 0; i < 3000; ++i) {
+            seed = seed * 1103515245 + 12345;
+            unsigned r = seed >> 12;
+            snprintf(path, sizeof(path), "/usr/share/some/deep/dir%u/%.*s%u",
+                     r % 7, (int) (r % 3), "sub", (r >> 4) % 8);
+            info.mtime.tv_sec = i;
+            add_info_to_list(&list, &info);
+        }
+        lstime_sort_list(&list, &opts);
+
+        du_assert_int_eq(list.num_elems, 3000, "path sort keeps all items");
+        du_assert_true(check_sorted(&list, &opts, cmp_path), "path sort order");
+        lstime_list_free(&list);
+    }
+    return true;
+}
+
+// --limit keeps the first n in sort order; many replacements also
+// exercise the compaction of the path arena
+static bool test_limit_heap(void) {
+    arr_wrapper list;
+    memset(&list, 0, sizeof(list));
+    lstime_options opts;
+    lstime_set_option_defaults(&opts);
+    opts.sort_field = 'm';
+    opts.limit = 3;
+
+    char path[128];
+    lstime_info info;
+    memset(&info, 0, sizeof(info));
+    info.path = path;
+    for (int i = 0; i < 40000; ++i) {
+        snprintf(path, sizeof(path), "%064d", i);
+        info.mtime.tv_sec = i;
+        info.mtime.tv_nsec = 0;
+        lstime_list_offer(&list, &opts, &info);
+    }
+    for (int i = 0; i < 5; ++i) {   // ties keep arrival order
+        snprintf(path, sizeof(path), "tie%d", i);
+        info.mtime.tv_sec = 39998;
+        lstime_list_offer(&list, &opts, &info);
+    }
+    lstime_sort_list(&list, &opts);
+
+    du_assert_int_eq(list.num_elems, 3, "limit");
+    du_assert_int_eq(item(&list, 0).mtime.tv_sec, 39999, " ");
+    du_assert_int_eq(item(&list, 1).mtime.tv_sec, 39998, " ");
+    du_assert_int_eq(item(&list, 2).mtime.tv_sec, 39998, " ");
+    snprintf(path, sizeof(path), "%064d", 39999);
+    du_assert_str_eq(item(&list, 0).path, path, " ");
+    snprintf(path, sizeof(path), "%064d", 39998);
+    du_assert_str_eq(item(&list, 1).path, path, " ");
+    du_assert_str_eq(item(&list, 2).path, "tie0", " ");
+    lstime_list_free(&list);
+    return true;
+}
+
+// mtime,path: paths order bytewise after times, with byte 1 and shorter
+// paths placed right in both directions
+static bool test_compound_sort(void) {
+    static const char *paths[] = { "a\x01", "b", "a", "ab", "a\x01b", "a" };
+    static const long secs[] = { 5, 7, 5, 5, 5, 5 };
+    static const char *fwd[] = { "b", "a", "a", "a\x01", "a\x01b", "ab" };
+    static const char *rev[] = { "ab", "a\x01b", "a\x01", "a", "a", "b" };
+    for (int reverse = 0; reverse <= 1; ++reverse) {
+        arr_wrapper list;
+        memset(&list, 0, sizeof(list));
+        lstime_options opts;
+        lstime_set_option_defaults(&opts);
+        opts.reverse = reverse;
+        opts.sort_field = 'm';
+        strcpy(opts.sort_keys, "mp");
+
+        lstime_info info;
+        memset(&info, 0, sizeof(info));
+        for (int i = 0; i < 6; ++i) {
+            info.path = paths[i];
+            info.mtime.tv_sec = secs[i];
+            info.mtime.tv_nsec = 0;
+            add_info_to_list(&list, &info);
+        }
+        lstime_sort_list(&list, &opts);
+        for (int i = 0; i < 6; ++i) {
+            du_assert_str_eq(item(&list, i).path, reverse ? rev[i] : fwd[i], "compound order");
+        }
+        lstime_list_free(&list);
+    }
+    return true;
+}
+
+static char *sorted_output(const lstime_options *opts, size_t num_items) {
+    char *mem = NULL;
+    size_t mem_size = 0;
+    FILE *fp = open_memstream(&mem, &mem_size);
+    lstime_writer out;
+    lstime_writer_init_fp(&out, fp, 4096);
+    arr_wrapper list;
+    memset(&list, 0, sizeof(list));
+    list.fields = lstime_list_fields(opts);
+
+    char path[64];
+    lstime_info info;
+    memset(&info, 0, sizeof(info));
+    info.path = path;
+    unsigned seed = 4321;
+    for (size_t i = 0; i < num_items; ++i) {
+        seed = seed * 1103515245 + 12345;
+        snprintf(path, sizeof(path), "path %u %zu", (seed >> 16) % 5000, i);
+        info.mtime.tv_sec = (seed >> 8) % 1000;  // lots of ties
+        info.mtime.tv_nsec = (i % 3 == 0) ? -1 : 0;
+        lstime_emit_info(&out, &list, opts, &info);
+    }
+    if (!lstime_spill_finish(&out, &list, opts)) {
+        lstime_sort_list(&list, opts);
+        lstime_output_list(&out, &list, opts);
+    }
+    lstime_writer_finit(&out);
+    fclose(fp);
+    lstime_list_free(&list);
+    return mem;
+}
+
+// --max-memory spills sorted runs (enough to need a cascade merge) and
+// must output exactly what the in-memory sort does
+static bool test_spill_merge(void) {
+    for (int field = 0; field < 3; ++field) {
+        lstime_options opts;
+        lstime_set_option_defaults(&opts);
+        opts.sort_field = (field == 1) ? 'p' : 'm';
+        opts.reverse = (field == 1);
+        if (field == 2) {
+            strcpy(opts.sort_keys, "mp");  // compound
+        }
+        opts.item_format = "%m %r%n";
+        opts.time_format = "%s";
+        lstime_item_prog *prog = lstime_compile_item_format(opts.item_format);
+        opts.item_prog = prog;
+
+        char *expected = sorted_output(&opts, 150000);
+        opts.max_memory = 300 * 1024;
+        char *spilled = sorted_output(&opts, 150000);
+        du_assert_int_eq(strlen(spilled), strlen(expected), "spill length");
+        du_assert_int_eq(strcmp(spilled, expected), 0, "spill output");
+        free(expected);
+        free(spilled);
+        lstime_free_item_prog(prog);
+    }
+    return true;
+}
 
 int format_timestamp_suite(void) {
     du_add(test_unix_epoch());
@@ -189,9 +786,23 @@ int format_timestamp_suite(void) {
     du_add(test_msec());
     du_add(test_year_2038_problem());
     du_add(test_timezone());
+    du_add(test_tz_cache());
+    du_add(test_fast_segs());
+    du_add(test_epoch_secs());
+    du_add(test_long_format());
+    du_add(test_format_timestamp_r());
+    du_add(test_format_threads());
     du_add(test_fwd_m_sort());
     du_add(test_rev_a_sort());
     du_add(test_fwd_p_sort());
     du_add(test_rev_p_sort());
+    du_add(test_radix_sort());
+    du_add(test_parallel_sort());
+    du_add(test_presorted_sort());
+    du_add(test_list_fields());
+    du_add(test_path_sort_prefixes());
+    du_add(test_limit_heap());
+    du_add(test_compound_sort());
+    du_add(test_spill_merge());
     return du_suite_summary("lstime_format_timestamp Test Suite Summary");
 }
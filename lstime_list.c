@@ -0,0 +1,361 @@
+// SPDX-FileCopyrightText: © 2023 Daniel D. Mickey III
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "lstime_private.h"
+
+// The buffered list is a struct-of-arrays: one column of paths and, for
+// each timestamp field actually needed by the item format or sort key, a
+// column of seconds and a column of nanoseconds packed into 32 bits.
+// A list with fields == 0 (like a memset one) keeps all four fields.
+// Path and sort key strings live in the list's arena.
+
+#define LIST_COMPACT_SLACK (1024 * 1024)
+
+static const int field_letters[LSTIME_NUM_FIELDS] = { 'm', 'a', 'c', 'b' };
+
+// index of a field letter in the columns, or -1 if not a timestamp
+int lstime_field_index(int field) {
+    for (int f = 0; f < LSTIME_NUM_FIELDS; ++f) {
+        if (field_letters[f] == field) {
+            return f;
+        }
+    }
+    return -1;
+}
+
+unsigned lstime_list_fields(const lstime_options *opts) {
+    if (opts->item_prog == NULL) {
+        return LSTIME_ALL_FIELDS;
+    }
+    unsigned fields = 0;
+    const lstime_item_op *op = opts->item_prog->ops;
+    const lstime_item_op *end = op + opts->item_prog->num_ops;
+    for ( ; op < end ; ++op) {
+        int f = lstime_field_index(op->directive);
+        if (f >= 0) {
+            fields |= 1u << f;
+        }
+    }
+    for (const char *k = opts->sort_keys; *k != '\0'; ++k) {
+        int f = lstime_field_index(*k);
+        if (f >= 0) {
+            fields |= 1u << f;
+        }
+    }
+    int f = lstime_field_index(opts->sort_field);
+    if (f >= 0) {
+        fields |= 1u << f;
+    }
+    return (fields == 0) ? LSTIME_NO_FIELDS : fields;
+}
+
+static void *grow_column(void *col, size_t new_cap, size_t size) {
+    col = reallocarray(col, new_cap, size);
+    if (col == NULL) {
+        err("list array out of memory: %s", strerror(errno));
+        exit(32);
+    }
+    return col;
+}
+
+static timespec get_timespec(const arr_wrapper *list, int f, size_t i) {
+    timespec ts;
+    if (list->secs[f] == NULL) {
+        SET_TIMESPEC_EMPTY(&ts);
+    } else {
+        ts.tv_sec = list->secs[f][i];
+        ts.tv_nsec = list->nsecs[f][i];
+    }
+    return ts;
+}
+
+// grow every column that is in use so that n items fit
+static void list_reserve(arr_wrapper *list, size_t n) {
+    if (n <= list->capacity) {
+        return;
+    }
+    size_t new_cap = MAX(list->capacity * 2, n);
+    if (new_cap < 2048) {
+        new_cap = 2048;
+    }
+    list->paths = grow_column(list->paths, new_cap, sizeof(char *));
+    for (int f = 0; f < LSTIME_NUM_FIELDS; ++f) {
+        if (list->fields & (1u << f)) {
+            list->secs[f] = grow_column(list->secs[f], new_cap, sizeof(int64_t));
+            list->nsecs[f] = grow_column(list->nsecs[f], new_cap, sizeof(int32_t));
+        }
+    }
+    if (list->limit > 0) {
+        list->seqs = grow_column(list->seqs, new_cap, sizeof(size_t));
+        list->heap = grow_column(list->heap, new_cap, sizeof(size_t));
+        if (list->keyed) {
+            list->sortkeys = grow_column(list->sortkeys, new_cap, sizeof(char *));
+        }
+    }
+    list->capacity = new_cap;
+}
+
+static void set_times(arr_wrapper *list, size_t i, const lstime_info *info) {
+    const timespec *times[LSTIME_NUM_FIELDS] = {
+        &info->mtime, &info->atime, &info->ctime, &info->btime
+    };
+    for (int f = 0; f < LSTIME_NUM_FIELDS; ++f) {
+        if (list->secs[f] != NULL) {
+            list->secs[f][i] = times[f]->tv_sec;
+            list->nsecs[f][i] = (int32_t) times[f]->tv_nsec;  // -1 to 999999999
+        }
+    }
+}
+
+void add_info_to_list(arr_wrapper *list, const lstime_info *info) {
+    if (list->fields == 0) {
+        list->fields = LSTIME_ALL_FIELDS;
+    }
+    list_reserve(list, list->num_elems + 1);
+    size_t i = list->num_elems;
+    list->paths[i] = lstime_arena_strdup(&list->strings, info->path);
+    set_times(list, i, info);
+    ++list->num_elems;
+}
+
+// --limit: only the first limit items in sort order are kept, in a heap
+// of slot indexes with the item that sorts last on top.  A new item goes
+// into the spare slot past the heap (its strings still borrowed), and
+// replaces the top only if it sorts before it.  Equal keys go by arrival
+// order (seqs), so the result matches a full sort cut to limit items.
+
+// true if slot a sorts after slot b
+static bool sorts_after(const arr_wrapper *list,
+                        const lstime_options *opts,
+                        size_t a,
+                        size_t b) {
+    int rc = 0;
+    bool rev = opts->reverse;
+    if (list->keyed) {
+        rc = strcmp(list->sortkeys[a], list->sortkeys[b]);
+        rev = rev && !SORT_IS_COMPOUND(opts);  // compound keys are ascending
+    } else if (opts->sort_field == 'p') {
+        rc = strcmp(list->paths[a], list->paths[b]);  // byte order collation
+    } else {
+        int f = lstime_field_index(opts->sort_field);
+        int64_t sec_a = list->secs[f][a];
+        int64_t sec_b = list->secs[f][b];
+        int32_t nsec_a = list->nsecs[f][a];
+        int32_t nsec_b = list->nsecs[f][b];
+        rc = (sec_a != sec_b) ? ((sec_a < sec_b) ? 1 : -1) :
+            (nsec_b > nsec_a) - (nsec_b < nsec_a);  // newest first
+    }
+    if (rev) {
+        rc = -rc;
+    }
+    return (rc != 0) ? (rc > 0) : (list->seqs[a] > list->seqs[b]);
+}
+
+static void heap_sift_up(arr_wrapper *list, const lstime_options *opts, size_t k) {
+    size_t *heap = list->heap;
+    while (k > 0) {
+        size_t parent = (k - 1) / 2;
+        if (!sorts_after(list, opts, heap[k], heap[parent])) {
+            break;
+        }
+        size_t t = heap[k];
+        heap[k] = heap[parent];
+        heap[parent] = t;
+        k = parent;
+    }
+}
+
+static void heap_sift_down(arr_wrapper *list, const lstime_options *opts) {
+    size_t *heap = list->heap;
+    size_t n = list->num_elems;
+    size_t k = 0;
+    for (;;) {
+        size_t top = k;
+        size_t left = 2 * k + 1;
+        size_t right = left + 1;
+        if (left < n && sorts_after(list, opts, heap[left], heap[top])) {
+            top = left;
+        }
+        if (right < n && sorts_after(list, opts, heap[right], heap[top])) {
+            top = right;
+        }
+        if (top == k) {
+            break;
+        }
+        size_t t = heap[k];
+        heap[k] = heap[top];
+        heap[top] = t;
+        k = top;
+    }
+}
+
+// copy the live strings into a fresh arena once replaced ones dominate
+static void list_compact(arr_wrapper *list) {
+    lstime_arena strings;
+    memset(&strings, 0, sizeof(strings));
+    for (size_t i = 0; i < list->num_elems; ++i) {
+        list->paths[i] = lstime_arena_strdup(&strings, list->paths[i]);
+        if (list->keyed) {
+            list->sortkeys[i] = lstime_arena_strdup(&strings, list->sortkeys[i]);
+        }
+    }
+    lstime_arena_free(&list->strings);
+    list->strings = strings;
+    list->dead_bytes = 0;
+}
+
+static size_t slot_bytes(const arr_wrapper *list, size_t i) {
+    size_t bytes = strlen(list->paths[i]) + 1;
+    if (list->keyed) {
+        bytes += strlen(list->sortkeys[i]) + 1;
+    }
+    return bytes;
+}
+
+void lstime_list_offer(arr_wrapper *list,
+                       const lstime_options *opts,
+                       const lstime_info *info) {
+    if (list->fields == 0) {
+        list->fields = LSTIME_ALL_FIELDS;
+    }
+    list->limit = opts->limit;
+    if (list->num_seen == 0) {  // the collation is looked up once
+        list->collate_bytes = lstime_collate_is_bytes();
+        list->keyed = SORT_IS_COMPOUND(opts) ||
+            (opts->sort_field == 'p' && !list->collate_bytes);
+    }
+    list_reserve(list, list->num_elems + 1);  // room for the spare slot
+
+    size_t spare = list->num_elems;
+    list->paths[spare] = info->path;
+    if (list->keyed) {
+        list->sortkeys[spare] = SORT_IS_COMPOUND(opts) ?
+            lstime_compound_sortkey(info, opts, list->collate_bytes) :
+            lstime_path_sortkey(info->path);
+    }
+    set_times(list, spare, info);
+    list->seqs[spare] = list->num_seen++;
+
+    size_t slot = spare;
+    size_t old_bytes = 0;
+    if (list->num_elems < list->limit) {
+        list->heap[list->num_elems++] = spare;
+    } else if (sorts_after(list, opts, list->heap[0], spare)) {
+        slot = list->heap[0];  // the new item replaces the top
+        old_bytes = slot_bytes(list, slot);
+        list->dead_bytes += old_bytes;
+        list->paths[slot] = info->path;
+        if (list->keyed) {
+            list->sortkeys[slot] = list->sortkeys[spare];
+        }
+        set_times(list, slot, info);
+        list->seqs[slot] = list->seqs[spare];
+    } else {
+        return;
+    }
+
+    list->live_bytes += slot_bytes(list, slot);
+    list->live_bytes -= old_bytes;
+    list->paths[slot] = lstime_arena_strdup(&list->strings, list->paths[slot]);
+    if (list->keyed) {
+        list->sortkeys[slot] = lstime_arena_strdup(&list->strings,
+                                                   list->sortkeys[slot]);
+    }
+    if (slot == spare) {
+        heap_sift_up(list, opts, list->num_elems - 1);
+    } else {
+        heap_sift_down(list, opts);
+    }
+    if (list->dead_bytes > list->live_bytes + LIST_COMPACT_SLACK) {
+        list_compact(list);
+    }
+}
+
+static int comp_seq(const void *v1, const void *v2) {
+    const size_t *p1 = v1;
+    const size_t *p2 = v2;
+    return (p1[0] > p2[0]) - (p1[0] < p2[0]);
+}
+
+// back to plain list: slots are put in arrival order for the final sort
+void lstime_list_end_limit(arr_wrapper *list) {
+    if (list->seqs == NULL) {
+        return;
+    }
+    size_t n = list->num_elems;
+    size_t (*pairs)[2] = reallocarray(NULL, n + 1, sizeof(*pairs));
+    if (pairs == NULL) {
+        err("sort out of memory: %s", strerror(errno));
+        exit(48);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        pairs[i][0] = list->seqs[i];
+        pairs[i][1] = i;
+    }
+    qsort(pairs, n, sizeof(*pairs), comp_seq);
+    size_t *order = list->heap;
+    for (size_t i = 0; i < n; ++i) {
+        order[i] = pairs[i][1];
+    }
+    lstime_list_permute(list, order);
+    free(pairs);
+    free(list->seqs);
+    free(list->heap);
+    list->seqs = NULL;
+    list->heap = NULL;
+    list->limit = 0;
+}
+
+// unpack item i; fields that are not kept read as N/A
+void lstime_list_get(const arr_wrapper *list, size_t i, lstime_info *info) {
+    info->path = list->paths[i];
+    info->sortkey = (list->sortkeys != NULL) ? list->sortkeys[i] : NULL;
+    info->mtime = get_timespec(list, 0, i);
+    info->atime = get_timespec(list, 1, i);
+    info->ctime = get_timespec(list, 2, i);
+    info->btime = get_timespec(list, 3, i);
+}
+
+// gather one column through order, using scratch (n * 8 bytes)
+#define GATHER(TYPE, COL, ORDER, N, SCRATCH)            \
+    do {                                                \
+        TYPE *tmp_ = (TYPE *) (SCRATCH);                \
+        for (size_t i_ = 0; i_ < (N); ++i_) {           \
+            tmp_[i_] = (COL)[(ORDER)[i_]];              \
+        }                                               \
+        memcpy((COL), tmp_, (N) * sizeof(TYPE));        \
+    } while (0)
+
+// reorder all columns so that item order[i] ends up at i
+void lstime_list_permute(arr_wrapper *list, const size_t *order) {
+    size_t n = list->num_elems;
+    void *scratch = reallocarray(NULL, n, sizeof(int64_t));
+    if (scratch == NULL) {
+        err("sort out of memory: %s", strerror(errno));
+        exit(48);
+    }
+    GATHER(const char *, list->paths, order, n, scratch);
+    if (list->sortkeys != NULL) {
+        GATHER(const char *, list->sortkeys, order, n, scratch);
+    }
+    for (int f = 0; f < LSTIME_NUM_FIELDS; ++f) {
+        if (list->secs[f] != NULL) {
+            GATHER(int64_t, list->secs[f], order, n, scratch);
+            GATHER(int32_t, list->nsecs[f], order, n, scratch);
+        }
+    }
+    free(scratch);
+}
+
+void lstime_list_free(arr_wrapper *list) {
+    lstime_arena_free(&list->strings);
+    free(list->paths);
+    free(list->sortkeys);
+    free(list->seqs);
+    free(list->heap);
+    for (int f = 0; f < LSTIME_NUM_FIELDS; ++f) {
+        free(list->secs[f]);
+        free(list->nsecs[f]);
+    }
+    memset(list, 0, sizeof(*list));
+}
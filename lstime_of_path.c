@@ -9,73 +9,85 @@
 
 
 static void cleanup(arr_wrapper *list) {
-    lstime_iconv_finit();
-    lstime_info *ptr = list->arr;
-    lstime_info *end = ptr + list->num_elems;
-    for ( ; ptr < end ; ++ptr) {
-        free((void *)ptr->path); // override const
-        ptr->path = NULL;
-        if (ptr->sortkey != NULL) {
-            free((void *)ptr->sortkey); // override const
-            ptr->sortkey = NULL;
-        }
-    }
-    free(list->arr);
-    list->arr = NULL;
-    list->capacity = 0;
-    list->num_elems = 0;
+    lstime_stat_path_finit();
+    lstime_format_ctx_free(lstime_thread_format_ctx());
+    lstime_list_free(list);
 }
 
-void lstime_output_list(FILE *fpout,
+void lstime_output_list(lstime_writer *out,
                         const arr_wrapper *list,
                         const lstime_options *opts) {
+    lstime_info info;
     for (size_t i = 0; i < list->num_elems; ++i) {
-        lstime_output_item(fpout, &list->arr[i], opts);
+        lstime_list_get(list, i, &info);
+        lstime_output_item(out, &info, opts);
     }
 }
 
-void add_info_to_list(arr_wrapper *list, const lstime_info *info) {
-    if (list->num_elems + 1 > list->capacity) {
-        size_t new_cap = list->capacity * 2;
-        if (new_cap < 2048) {
-            new_cap = 2048;
-        }
-        list->arr = reallocarray(list->arr, new_cap, sizeof(lstime_info));
-        if (list->arr == NULL) {
-            err("list array out of memory: %s", strerror(errno));
-            exit(32);
+// --sort none with --limit: true once the items output, plus pending ones
+// sure to be output (already in flight), reach the limit, so no more
+// paths need to be stat'ed
+bool lstime_limit_reached(const arr_wrapper *list,
+                          const lstime_options *opts,
+                          size_t pending) {
+    return opts->sort_field == 'n' && opts->limit > 0 && list != NULL &&
+        list->num_seen + pending >= opts->limit;
+}
+
+// output info now or buffer it for sorting; info->path is only borrowed
+void lstime_emit_info_r(lstime_format_ctx *ctx,
+                        lstime_writer *out,
+                        arr_wrapper *list,
+                        const lstime_options *opts,
+                        const lstime_info *info) {
+    if (opts->sort_field == 'n' || list == NULL) {  // sort=none, so immediately output
+        if (list != NULL && opts->limit > 0 && list->num_seen++ >= opts->limit) {
+            return;
         }
-        list->capacity = new_cap;
+        lstime_output_item_r(ctx, out, info, opts);
+    } else if (opts->limit > 0) {
+        lstime_list_offer(list, opts, info);  // keep only the best limit items
+    } else {
+        // build list for later sorting
+        lstime_spill_reserve(list, opts);  // --max-memory
+        add_info_to_list(list, info);
     }
-    list->arr[list->num_elems] = *info;
-    ++list->num_elems;
 }
 
-void lstime_of_path(FILE *fpout,
+void lstime_emit_info(lstime_writer *out,
+                      arr_wrapper *list,
+                      const lstime_options *opts,
+                      const lstime_info *info) {
+    lstime_emit_info_r(lstime_thread_format_ctx(), out, list, opts, info);
+}
+
+void lstime_of_path(lstime_writer *out,
                     arr_wrapper *list,
                     const lstime_options *opts,
                     const char *path) {
+    if (lstime_limit_reached(list, opts, 0)) {
+        return;  // already output enough
+    }
+    if (opts->recursive) {
+        lstime_walk_path(out, list, opts, path);
+        return;
+    }
+    if (opts->jobs > 1 || opts->io_engine == 'u') {
+        lstime_stat_pool_submit(out, list, opts, path);
+        return;
+    }
+
     lstime_info info;
-    info.path = strdup(path);
+    info.path = path;
     info.sortkey = NULL;
-    if (info.path == NULL) {
-        err("strdup out of memory: %s", strerror(errno));
-        exit(33);
-    }
     if (lstime_stat_path(&info, opts->stat_flags) != 0) {
         err("lstime_stat_path: %s: %s", info.path, strerror(errno));
         exit(3);
     }
-
-    if (opts->sort_field == 'n' || list == NULL) {  // sort=none, so immediately output
-        lstime_output_item(fpout, &info, opts);
-    } else {
-        // build list for later sorting
-        add_info_to_list(list, &info);
-    }
+    lstime_emit_info(out, list, opts, &info);
 }
 
-void lstime_parse_path_input_file(FILE *fpout,
+void lstime_parse_path_input_file(lstime_writer *out,
                                   arr_wrapper *list,
                                   const lstime_options *opts,
                                   const char *infile) {
@@ -96,7 +108,7 @@ void lstime_parse_path_input_file(FILE *fpout,
         if (opts->path_input_file_delim == '\n' && path[rc - 1] == '\n') {
             path[rc - 1] = '\0';  // trim trailing newline
         }
-        lstime_of_path(fpout, list, opts, path);
+        lstime_of_path(out, list, opts, path);
     }
     if (!feof(fpin)) { // there must have been an IO error
         err("getdelim: %s: IO error: %s", infile, strerror(errno));
@@ -113,18 +125,31 @@ void lstime_driver(FILE *fpout, int argc, char *argv[]) {
     lstime_options opts;
     lstime_set_option_defaults(&opts);
     lstime_parse_options(&opts, argc, argv);
+    lstime_writer writer;
+    lstime_writer *out = &writer;
+    if (fileno(fpout) >= 0) {
+        lstime_writer_init_fd(out, fpout, opts.write_buffer_size);
+    } else {
+        lstime_writer_init_fp(out, fpout, opts.write_buffer_size);  // memstream
+    }
     arr_wrapper list;
     memset(&list, 0, sizeof(list));
+    list.fields = lstime_list_fields(&opts);
 
     if (opts.path_input_file != NULL && opts.path_input_file[0] != '\0') {
-        lstime_parse_path_input_file(fpout, &list, &opts, opts.path_input_file);
+        lstime_parse_path_input_file(out, &list, &opts, opts.path_input_file);
     }
     for (; optind < argc; optind++) {
         char *path = argv[optind];
-        lstime_of_path(fpout, &list, &opts, path);
+        lstime_of_path(out, &list, &opts, path);
+    }
+    lstime_stat_pool_finish();  // emits any paths still in flight
+    if (!lstime_spill_finish(out, &list, &opts)) {
+        lstime_sort_list(&list, &opts);
+        lstime_output_list(out, &list, &opts);
     }
-    lstime_sort_list(&list, &opts);
-    lstime_output_list(fpout, &list, &opts);
+    lstime_writer_finit(out);
 
     cleanup(&list);  // about to exit, so this cleanup is optional
+    lstime_free_item_prog((lstime_item_prog *)opts.item_prog); // override const
 }
@@ -0,0 +1,536 @@
+// SPDX-FileCopyrightText: © 2023 Daniel D. Mickey III
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "lstime_tests.h"
+#include "lstime_private.h"
+
+// These tests run lstime on a scratch tree under /tmp.  Each run is in
+// a child process, since lstime exits on errors and keeps per-process
+// state (the stat pool, getopt).
+
+#define NUM_POOL_FILES 300
+#define WALK_DEPTH 140  // past the walker's 128 open directory fds
+#define NOBODY 65534
+
+static char tree[64];
+
+static bool tree_create(void) {
+    snprintf(tree, sizeof(tree), "/tmp/lstime_tests.XXXXXX");
+    return mkdtemp(tree) != NULL && chmod(tree, 0755) == 0;
+}
+
+static const char *tree_path(const char *rel) {
+    static char path[MAX_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/%s", tree, rel);
+    return path;
+}
+
+// a file with all its timestamps (but ctime and btime) set to secs
+static bool tree_file(const char *rel, time_t secs) {
+    int fd = open(tree_path(rel), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    struct timespec times[2] = { { secs, 0 }, { secs, 0 } };
+    bool ok = futimens(fd, times) == 0;
+    return close(fd) == 0 && ok;
+}
+
+static bool tree_dir(const char *rel, mode_t mode) {
+    return mkdir(tree_path(rel), 0700) == 0 && chmod(tree_path(rel), mode) == 0;
+}
+
+static bool tree_symlink(const char *target, const char *rel) {
+    return symlink(target, tree_path(rel)) == 0;
+}
+
+// a list of paths for -f, one per line
+static bool tree_list(const char *rel, const char *const paths[], size_t n) {
+    FILE *fp = fopen(tree_path(rel), "w");
+    if (fp == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        fprintf(fp, "%s/%s\n", tree, paths[i]);
+    }
+    return fclose(fp) == 0;
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag,
+                        struct FTW *ftwbuf) {
+    (void) sb; (void) flag; (void) ftwbuf;
+    return remove(path);
+}
+
+static void tree_remove(void) {
+    nftw(tree, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static bool run_unprivileged = false;  // as nobody, if run by root
+
+static char *read_all(FILE *fp) {
+    long len = (fseek(fp, 0, SEEK_END) == 0) ? ftell(fp) : -1;
+    char *str = (len >= 0) ? malloc(len + 1) : NULL;
+    if (str != NULL) {
+        rewind(fp);
+        str[fread(str, 1, len, fp)] = '\0';
+    }
+    fclose(fp);
+    return str;
+}
+
+// run lstime with the NULL terminated args in a child; returns its exit
+// status, with its output (and errors, unless NULL) in malloc'ed strings
+static int run_lstime(const char *const args[], char **output, char **errors) {
+    *output = NULL;
+    FILE *fp = tmpfile();
+    FILE *errfp = (errors != NULL) ? tmpfile() : fopen("/dev/null", "w");
+    if (fp == NULL || errfp == NULL) {
+        return -1;
+    }
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (dup2(fileno(errfp), STDERR_FILENO) < 0) {
+            _exit(98);
+        }
+        if (run_unprivileged && geteuid() == 0 &&
+            (setgid(NOBODY) != 0 || setuid(NOBODY) != 0)) {
+            _exit(97);
+        }
+        char *argv[32];
+        int argc = 0;
+        argv[argc++] = (char *) "lstime";
+        while (args[argc - 1] != NULL && argc < 31) {
+            argv[argc] = (char *) args[argc - 1];
+            ++argc;
+        }
+        argv[argc] = NULL;
+        optind = 0;  // restart getopt
+        lstime_driver(fp, argc, argv);
+        _exit(0);
+    }
+    int status = 0;
+    bool exited = pid > 0 && waitpid(pid, &status, 0) == pid &&
+        WIFEXITED(status);
+    *output = read_all(fp);
+    if (errors != NULL) {
+        *errors = read_all(errfp);
+    } else {
+        fclose(errfp);
+    }
+    return exited ? WEXITSTATUS(status) : -1;
+}
+
+static size_t count_lines(const char *str) {
+    size_t n = 0;
+    for ( ; *str != '\0'; ++str) {
+        n += (*str == '\n');
+    }
+    return n;
+}
+
+// run with args and again with the extra options added: both must exit
+// with status and output the same (lines of it)
+static bool same_as_sync(const char *const args[], const char *const extra[],
+                         int status, size_t *lines) {
+    const char *extra_args[32];
+    size_t n = 0;
+    for (size_t i = 0; extra[i] != NULL && n < 31; ++i) {
+        extra_args[n++] = extra[i];
+    }
+    for (size_t i = 0; args[i] != NULL && n < 31; ++i) {
+        extra_args[n++] = args[i];
+    }
+    extra_args[n] = NULL;
+
+    char *expected = NULL;
+    char *actual = NULL;
+    int rc1 = run_lstime(args, &expected, NULL);
+    int rc2 = run_lstime(extra_args, &actual, NULL);
+    bool same = expected != NULL && actual != NULL &&
+        strcmp(actual, expected) == 0;
+    *lines = (expected != NULL) ? count_lines(expected) : 0;
+    free(expected);
+    free(actual);
+    du_assert_int_eq(rc1, status, "sync exit status");
+    du_assert_int_eq(rc2, status, "%s %s exit status", extra[0], extra[1]);
+    du_assert_true(same, "%s %s output", extra[0], extra[1]);
+    return true;
+}
+
+// the test lists: all regular files and a dangling symlink ("list"), and
+// the same with a missing file ("bad_list")
+static bool make_lists(char *list, char *bad_list, size_t *num_paths) {
+    static const char *paths[NUM_POOL_FILES + 1];
+    static char names[NUM_POOL_FILES][8];
+    size_t n = 0;
+    for (int i = 0; i < NUM_POOL_FILES; ++i) {
+        snprintf(names[i], sizeof(names[i]), "f%03d", i);
+        du_assert_true(tree_file(names[i], 1700000000 + 7 * i), "create file");
+        paths[n++] = names[i];
+        if (i == NUM_POOL_FILES / 2) {
+            paths[n++] = "dangling";
+        }
+    }
+    du_assert_true(tree_symlink("nowhere", "dangling"), "create symlink");
+    du_assert_true(tree_list("list", paths, n), "create list");
+    paths[NUM_POOL_FILES / 4] = "missing";
+    du_assert_true(tree_list("bad_list", paths, n), "create list");
+    snprintf(list, MAX_PATH_LEN, "%s", tree_path("list"));
+    snprintf(bad_list, MAX_PATH_LEN, "%s", tree_path("bad_list"));
+    *num_paths = n;
+    return true;
+}
+
+// the stat engine selected by extra gives the same output and errors as
+// the synchronous run
+static bool check_engine(const char *const extra[], const char *list,
+                         const char *bad_list, size_t n) {
+    size_t lines = 0;
+
+    // with -P the dangling symlink itself is listed
+    const char *nofollow[] = { "-P", "-i", "%m %p%n", "-f", list, NULL };
+    du_assert_true(same_as_sync(nofollow, extra, 0, &lines), "-P");
+    du_assert_int_eq(lines, n, "all items");
+
+    // an error ends the run (exit 3) after the items before it; a small
+    // writer has flushed most of them
+    const char *follow[] = { "-W", "512", "-i", "%m %p%n", "-f", list, NULL };
+    du_assert_true(same_as_sync(follow, extra, 3, &lines), "dangling symlink");
+    du_assert_true(lines > 0 && lines <= NUM_POOL_FILES / 2 + 1,
+                   "items before the dangling symlink, %zu lines", lines);
+    const char *missing[] = { "-P", "-W", "512", "-i", "%m %p%n",
+                              "-f", bad_list, NULL };
+    du_assert_true(same_as_sync(missing, extra, 3, &lines), "missing file");
+    du_assert_true(lines > 0 && lines <= NUM_POOL_FILES / 4,
+                   "items before the missing file, %zu lines", lines);
+    return true;
+}
+
+static bool check_stat_pool(void) {
+    char list[MAX_PATH_LEN];
+    char bad_list[MAX_PATH_LEN];
+    size_t n = 0;
+    du_assert_true(make_lists(list, bad_list, &n), "test lists");
+    // more paths than the reorder window of -j 2 (128 slots), so slots
+    // are reused several times over
+    const char *two[] = { "-j", "2", NULL };
+    du_assert_true(check_engine(two, list, bad_list, n), "-j 2");
+    const char *seven[] = { "-j", "7", NULL };
+    du_assert_true(check_engine(seven, list, bad_list, n), "-j 7");
+    return true;
+}
+
+static bool test_stat_pool(void) {
+    du_assert_true(tree_create(), "create %s", tree);
+    bool ok = check_stat_pool();
+    tree_remove();
+    return ok;
+}
+
+static bool test_uring_fallback(void) {
+    lstime_options opts;
+    lstime_set_option_defaults(&opts);
+    opts.jobs = 4;
+    du_assert_int_eq(lstime_stat_pool_mode(&opts, false), POOL_THREADS,
+                     "--jobs");
+    opts.io_engine = 'u';
+    du_assert_int_eq(lstime_stat_pool_mode(&opts, true), POOL_URING,
+                     "uring with --jobs");
+    du_assert_int_eq(lstime_stat_pool_mode(&opts, false), POOL_THREADS,
+                     "no uring, --jobs");
+    opts.jobs = 1;
+    du_assert_int_eq(lstime_stat_pool_mode(&opts, true), POOL_URING,
+                     "uring");
+    du_assert_int_eq(lstime_stat_pool_mode(&opts, false), POOL_SYNC,
+                     "no uring, one job");
+
+    lstime_uring_disable(true);
+    errno = 0;
+    lstime_uring *ring = lstime_uring_open(8);
+    int open_errno = errno;
+    lstime_uring_disable(false);
+    lstime_uring_close(ring);
+    du_assert_true(ring == NULL, "disabled uring");
+    du_assert_int_eq(open_errno, EOPNOTSUPP, "disabled uring errno");
+    return true;
+}
+
+static bool check_uring(void) {
+    char list[MAX_PATH_LEN];
+    char bad_list[MAX_PATH_LEN];
+    size_t n = 0;
+    du_assert_true(make_lists(list, bad_list, &n), "test lists");
+    // a window of 8 statx requests in flight
+    const char *uring[] = { "-I", "uring", "-Q", "8", NULL };
+    du_assert_true(check_engine(uring, list, bad_list, n), "uring");
+
+    // the children inherit the disabled uring
+    lstime_uring_disable(true);
+    const char *sync[] = { "-I", "uring", "-Q", "8", NULL };
+    bool sync_ok = check_engine(sync, list, bad_list, n);
+    const char *threads[] = { "-I", "uring", "-j", "3", NULL };
+    bool threads_ok = check_engine(threads, list, bad_list, n);
+    lstime_uring_disable(false);
+    du_assert_true(sync_ok, "uring fallback to synchronous statx");
+    du_assert_true(threads_ok, "uring fallback to threads");
+    return true;
+}
+
+static bool test_uring(void) {
+    du_assert_true(tree_create(), "create %s", tree);
+    bool ok = check_uring();
+    tree_remove();
+    return ok;
+}
+
+// split output into its lines, in place
+static size_t split_lines(char *str, char *lines[], size_t max_lines) {
+    size_t n = 0;
+    for (char *nl; n < max_lines && (nl = strchr(str, '\n')) != NULL; ) {
+        *nl = '\0';
+        lines[n++] = str;
+        str = nl + 1;
+    }
+    return n;
+}
+
+static int compare_strs(const void *a, const void *b) {
+    return strcmp(*(const char *const *) a, *(const char *const *) b);
+}
+
+static bool is_below(const char *path, const char *dir) {
+    size_t len = strlen(dir);
+    return strncmp(path, dir, len) == 0 && path[len] == '/';
+}
+
+static size_t path_depth(const char *path) {
+    size_t n = 0;
+    for ( ; *path != '\0'; ++path) {
+        n += (*path == '/');
+    }
+    return n;
+}
+
+// -R lists a directory before anything below it, and all of a
+// directory's entries before descending into its subdirectories
+static bool check_walk_order(char *lines[], size_t n) {
+    for (size_t j = 0; j < n; ++j) {
+        char parent[MAX_PATH_LEN];
+        snprintf(parent, sizeof(parent), "%s", lines[j]);
+        *strrchr(parent, '/') = '\0';
+        for (size_t i = 0; i < j; ++i) {
+            du_assert_true(!is_below(lines[i], lines[j]),
+                           "%s listed before its directory", lines[i]);
+            du_assert_true(!is_below(lines[i], parent) ||
+                           path_depth(lines[i]) <= path_depth(lines[j]),
+                           "%s listed before %s", lines[i], lines[j]);
+        }
+    }
+    return true;
+}
+
+// a scratch tree for -R; expected gets the paths it should list, sorted
+static bool make_walk_tree(char *expected[], size_t *num_expected) {
+    static const struct { const char *rel; bool dir; } entries[] = {
+        { "a", true }, { "a/f1", false }, { "a/f2", false },
+        { "a/sub", true }, { "a/sub/g", false }, { "b", false },
+        { "locked", true }, { "deep", true },
+    };
+    static char paths[WALK_DEPTH + 16][MAX_PATH_LEN];
+    size_t n = 0;
+    snprintf(paths[n++], sizeof(paths[0]), "%s", tree);
+    for (size_t i = 0; i < sizeof(entries) / sizeof(entries[0]); ++i) {
+        bool ok = entries[i].dir ? tree_dir(entries[i].rel, 0755) :
+            tree_file(entries[i].rel, 1700000000 + i);
+        du_assert_true(ok, "create %s", entries[i].rel);
+        snprintf(paths[n++], sizeof(paths[0]), "%s", tree_path(entries[i].rel));
+    }
+    char rel[2 * WALK_DEPTH + 16] = "deep";
+    for (int i = 0; i < WALK_DEPTH; ++i) {
+        strcat(rel, "/d");
+        du_assert_true(tree_dir(rel, 0755), "create %s", rel);
+        snprintf(paths[n++], sizeof(paths[0]), "%s", tree_path(rel));
+    }
+    strcat(rel, "/end");
+    du_assert_true(tree_file(rel, 1700000000), "create %s", rel);
+    snprintf(paths[n++], sizeof(paths[0]), "%s", tree_path(rel));
+
+    // not listed: a dangling symlink (its target cannot be stat'ed), and
+    // what is in an unreadable directory
+    du_assert_true(tree_symlink("nowhere", "a/dangling"), "create symlink");
+    du_assert_true(tree_file("locked/secret", 1700000000), "create locked file");
+    du_assert_true(chmod(tree_path("locked"), 0) == 0, "lock directory");
+
+    for (size_t i = 0; i < n; ++i) {
+        expected[i] = paths[i];
+    }
+    *num_expected = n;
+    qsort(expected, n, sizeof(char *), compare_strs);
+    return true;
+}
+
+// lstime -R on the tree lists exactly the expected paths
+static bool check_walk_output(const char *const args[], char *expected[],
+                              size_t num_expected, bool check_order) {
+    char *output = NULL;
+    run_unprivileged = true;
+    int rc = run_lstime(args, &output, NULL);
+    run_unprivileged = false;
+    du_assert_int_eq(rc, 0, "exit status");
+    du_assert_true(output != NULL, "output");
+
+    char *lines[WALK_DEPTH + 32];
+    size_t n = split_lines(output, lines, WALK_DEPTH + 32);
+    bool ordered = !check_order || check_walk_order(lines, n);
+    qsort(lines, n, sizeof(char *), compare_strs);
+    bool same = n == num_expected;
+    for (size_t i = 0; i < n && same; ++i) {
+        same = strcmp(lines[i], expected[i]) == 0;
+    }
+    free(output);
+    du_assert_true(ordered, "output order");
+    du_assert_int_eq(n, num_expected, "paths listed");
+    du_assert_true(same, "paths listed");
+    return true;
+}
+
+// with --sort none, --limit lists exactly limit paths; without --jobs
+// the walk also stops there, before the entries that warn
+static bool check_walk_limit(const char *const args[], char *expected[],
+                             size_t num_expected, size_t limit,
+                             bool check_stop) {
+    char *output = NULL;
+    char *errors = NULL;
+    run_unprivileged = true;
+    int rc = run_lstime(args, &output, &errors);
+    run_unprivileged = false;
+    bool quiet = errors != NULL && errors[0] == '\0';
+    free(errors);
+    du_assert_int_eq(rc, 0, "exit status");
+    du_assert_true(output != NULL, "output");
+
+    char *lines[WALK_DEPTH + 32];
+    size_t n = split_lines(output, lines, WALK_DEPTH + 32);
+    bool known = true;
+    for (size_t i = 0; i < n && known; ++i) {
+        known = bsearch(&lines[i], expected, num_expected, sizeof(char *),
+                        compare_strs) != NULL;
+    }
+    free(output);
+    du_assert_int_eq(n, limit, "paths listed");
+    du_assert_true(known, "paths from the tree");
+    du_assert_true(quiet || !check_stop, "no warnings past the limit");
+    return true;
+}
+
+static bool check_walk(void) {
+    char *expected[WALK_DEPTH + 16];
+    size_t n = 0;
+    du_assert_true(make_walk_tree(expected, &n), "walk tree");
+    const char *args[] = { "-R", "-i", "%r%n", tree, NULL };
+    du_assert_true(check_walk_output(args, expected, n, true), "-R");
+
+    // the parallel walk lists the same paths, in no particular order
+    for (int i = 0; i < 20; ++i) {
+        const char *jobs[] = { "-R", "-j", "4", "-i", "%r%n", tree, NULL };
+        du_assert_true(check_walk_output(jobs, expected, n, false),
+                       "-R -j 4, run %d", i);
+    }
+
+    const char *limit[] = { "-R", "-N", "5", "-i", "%r%n", tree, NULL };
+    du_assert_true(check_walk_limit(limit, expected, n, 5, true), "-R -N 5");
+    const char *limit_jobs[] = { "-R", "-j", "4", "-N", "5", "-i", "%r%n",
+                                 tree, NULL };
+    du_assert_true(check_walk_limit(limit_jobs, expected, n, 5, false),
+                   "-R -j 4 -N 5");
+    return true;
+}
+
+static bool test_walk(void) {
+    du_assert_true(tree_create(), "create %s", tree);
+    bool ok = check_walk();
+    chmod(tree_path("locked"), 0755);
+    tree_remove();
+    return ok;
+}
+
+// mtime of a scratch tree path through the dir fd cache, -1 on errors
+static time_t cached_mtime(const char *rel) {
+    lstime_info info;
+    info.path = tree_path(rel);
+    if (lstime_stat_path(&info, AT_STATX_SYNC_AS_STAT) != 0) {
+        return -1;
+    }
+    return info.mtime.tv_sec;
+}
+
+static bool tree_rename(const char *rel, const char *new_rel) {
+    char rel_path[MAX_PATH_LEN];
+    snprintf(rel_path, sizeof(rel_path), "%s", tree_path(rel));
+    return rename(rel_path, tree_path(new_rel)) == 0;
+}
+
+// replace the directory rel with a new one (the old one moved to old)
+static bool tree_replace_dir(const char *rel, const char *old) {
+    return tree_rename(rel, old) && tree_dir(rel, 0755);
+}
+
+static bool check_dir_cache(void) {
+    du_assert_true(tree_dir("a", 0755) && tree_dir("b", 0755) &&
+                   tree_dir("c", 0755) && tree_dir("c/d", 0755), "create dirs");
+    du_assert_true(tree_file("a/f1", 100) && tree_file("a/f2", 101) &&
+                   tree_file("b/g", 102) && tree_file("c/d/h", 103),
+                   "create files");
+    du_assert_int_eq(cached_mtime("a/f1"), 100, "first path in a");
+    du_assert_int_eq(cached_mtime("a/f2"), 101, "second path in a");
+
+    // renamed while its paths are being stat'ed
+    du_assert_true(tree_replace_dir("a", "a_old1"), "replace a");
+    du_assert_true(tree_file("a/f2", 201), "create file");
+    du_assert_int_eq(cached_mtime("a/f2"), 201, "a replaced in a run");
+
+    // renamed while another directory's paths are stat'ed
+    du_assert_int_eq(cached_mtime("b/g"), 102, "path in b");
+    du_assert_true(tree_replace_dir("a", "a_old2"), "replace a");
+    du_assert_true(tree_file("a/f2", 301), "create file");
+    du_assert_int_eq(cached_mtime("a/f2"), 301, "a replaced between runs");
+    du_assert_int_eq(cached_mtime("b/g"), 102, "path in b again");
+    du_assert_true(tree_rename("a", "a_old3"), "move a");
+    du_assert_int_eq(cached_mtime("a/f2"), -1, "a gone");
+
+    // a directory above the parent renamed
+    du_assert_int_eq(cached_mtime("c/d/h"), 103, "first path in c/d");
+    du_assert_int_eq(cached_mtime("c/d/h"), 103, "second path in c/d");
+    du_assert_true(tree_replace_dir("c", "c_old") && tree_dir("c/d", 0755) &&
+                   tree_file("c/d/h", 403), "replace c");
+    du_assert_int_eq(cached_mtime("c/d/h"), 403, "c replaced");
+    return true;
+}
+
+static bool test_dir_cache(void) {
+    du_assert_true(tree_create(), "create %s", tree);
+    lstime_stat_path_finit();
+    bool ok = check_dir_cache();
+    lstime_stat_path_finit();
+    tree_remove();
+    return ok;
+}
+
+int of_path_suite(void) {
+    du_add(test_stat_pool());
+    du_add(test_uring_fallback());
+    du_add(test_uring());
+    du_add(test_walk());
+    du_add(test_dir_cache());
+    return du_suite_summary("lstime_of_path Test Suite Summary");
+}
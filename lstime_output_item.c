@@ -3,65 +3,50 @@
 
 #include "lstime_private.h"
 
-// higher level convenience function
-void lstime_output_item(FILE *fp,
-                        const lstime_info *info,
-                        const lstime_options *opts) {
-    lstime_out_it(fp,
-                  info,
-                  opts->item_format,
-                  opts->time_format,
-                  opts->format_time_as_utc,
-                  opts->debug);
-}
+// The item format is compiled once into a list of ops: runs of literal
+// text (with %n, %z and %% already folded in) and field directives.
+// Each record then just walks the op list.
 
-// lower level function, good for testing
-void lstime_out_it(FILE *fp,
-                   const lstime_info *info,
-                   const char* item_format,
-                   const char* time_format,
-                   bool utc,
-                   bool debug) {
-    for (size_t i = 0 ; i < strlen(item_format) ; ++i) {
-        int c = item_format[i];
+lstime_item_prog *lstime_compile_item_format(const char *item_format) {
+    size_t fmt_len = strlen(item_format);
+    lstime_item_prog *prog = malloc(sizeof(lstime_item_prog));
+    if (prog != NULL) {
+        prog->ops = malloc((fmt_len + 1) * sizeof(lstime_item_op));
+        prog->text = malloc(fmt_len + 1);
+    }
+    if (prog == NULL || prog->ops == NULL || prog->text == NULL) {
+        err("item format out of memory: %s", strerror(errno));
+        exit(44);
+    }
+    prog->num_ops = 0;
+
+    char *text_ptr = prog->text;
+    lstime_item_op *lit = NULL;  // literal op being extended
+    for (size_t i = 0; i < fmt_len; ++i) {
+        int c = (unsigned char) item_format[i];
         if (c == '%') {
-            c = item_format[++i];
+            c = (unsigned char) item_format[++i];
             switch (c) {
                 case 'm':
-                    fprintf(fp, "%s", lstime_format_timestamp(
-                                info->mtime, time_format, utc));
-                    break;
                 case 'a':
-                    fprintf(fp,"%s",  lstime_format_timestamp(
-                                info->atime, time_format, utc));
-                    break;
                 case 'c':
-                    fprintf(fp,"%s",  lstime_format_timestamp(
-                                info->ctime, time_format, utc));
-                    break;
                 case 'b':
-                    fprintf(fp,"%s",  lstime_format_timestamp(
-                                info->btime, time_format, utc));
-                    break;
-                case 'n':
-                    fputc('\n', fp);
-                    break;
                 case 'p':
-                    fprintf(fp, "%s", lstime_format_path(info->path,
-                                                         false, debug));
-                    break;
                 case 'r':
-                    fprintf(fp, "%s", info->path);
-                    break;
                 case 'u':
-                    fprintf(fp, "%s", lstime_format_path(info->path,
-                                                         true, debug));
+                    lit = NULL;
+                    prog->ops[prog->num_ops].directive = c;
+                    prog->ops[prog->num_ops].text = NULL;
+                    prog->ops[prog->num_ops].len = 0;
+                    ++prog->num_ops;
+                    continue;
+                case 'n':
+                    c = '\n';
                     break;
                 case 'z':
-                    fputc('\0', fp);
+                    c = '\0';
                     break;
                 case '%':
-                    fputc('%', fp);
                     break;
                 default:           // unrecognized % escape
                     err("unrecognized --output-format directive: %%%c",
@@ -69,9 +54,112 @@ void lstime_out_it(FILE *fp,
                     exit(15);
                     break;
             }
-        } else {
-            fputc((unsigned char) c, fp);
         }
+        if (lit == NULL) {
+            lit = &prog->ops[prog->num_ops++];
+            lit->directive = 0;
+            lit->text = text_ptr;
+            lit->len = 0;
+        }
+        *text_ptr++ = (char) c;
+        ++lit->len;
     }
+    return prog;
 }
 
+void lstime_free_item_prog(lstime_item_prog *prog) {
+    if (prog != NULL) {
+        free(prog->ops);
+        free(prog->text);
+        free(prog);
+    }
+}
+
+// formats into ctx, so workers with their own ctx can run it concurrently
+void lstime_run_item_prog_r(lstime_format_ctx *ctx,
+                            lstime_writer *out,
+                            const lstime_info *info,
+                            const lstime_item_prog *prog,
+                            const char *time_format,
+                            bool utc,
+                            bool debug) {
+    const lstime_item_op *op = prog->ops;
+    const lstime_item_op *end = op + prog->num_ops;
+    for ( ; op < end ; ++op) {
+        switch (op->directive) {
+            case 0:
+                lstime_writer_write(out, op->text, op->len);
+                break;
+            case 'm':
+                lstime_writer_puts(out, lstime_format_timestamp_r(ctx, info->mtime, time_format, utc));
+                break;
+            case 'a':
+                lstime_writer_puts(out, lstime_format_timestamp_r(ctx, info->atime, time_format, utc));
+                break;
+            case 'c':
+                lstime_writer_puts(out, lstime_format_timestamp_r(ctx, info->ctime, time_format, utc));
+                break;
+            case 'b':
+                lstime_writer_puts(out, lstime_format_timestamp_r(ctx, info->btime, time_format, utc));
+                break;
+            case 'p':
+                lstime_writer_puts(out, lstime_format_path_r(ctx, info->path, false, debug));
+                break;
+            case 'r':
+                lstime_writer_puts(out, info->path);
+                break;
+            case 'u':
+                lstime_writer_puts(out, lstime_format_path_r(ctx, info->path, true, debug));
+                break;
+        }
+    }
+}
+
+void lstime_run_item_prog(lstime_writer *out,
+                          const lstime_info *info,
+                          const lstime_item_prog *prog,
+                          const char *time_format,
+                          bool utc,
+                          bool debug) {
+    lstime_run_item_prog_r(lstime_thread_format_ctx(), out, info, prog,
+                           time_format, utc, debug);
+}
+
+// higher level convenience function
+void lstime_output_item_r(lstime_format_ctx *ctx,
+                          lstime_writer *out,
+                          const lstime_info *info,
+                          const lstime_options *opts) {
+    if (opts->item_prog == NULL) {  // lstime_parse_options compiles it
+        err("item format not compiled: %s", opts->item_format);
+        exit(51);
+    }
+    lstime_run_item_prog_r(ctx,
+                           out,
+                           info,
+                           opts->item_prog,
+                           opts->time_format,
+                           opts->format_time_as_utc,
+                           opts->debug);
+}
+
+void lstime_output_item(lstime_writer *out,
+                        const lstime_info *info,
+                        const lstime_options *opts) {
+    lstime_output_item_r(lstime_thread_format_ctx(), out, info, opts);
+}
+
+// lower level function, good for testing
+void lstime_out_it(FILE *fp,
+                   const lstime_info *info,
+                   const char* item_format,
+                   const char* time_format,
+                   bool utc,
+                   bool debug) {
+    lstime_writer out;
+    lstime_writer_init_fp(&out, fp, MAX_PATH_LEN);
+    lstime_item_prog *prog = lstime_compile_item_format(item_format);
+    lstime_run_item_prog(&out, info, prog, time_format, utc, debug);
+    lstime_free_item_prog(prog);
+    lstime_writer_finit(&out);
+}
@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #include "lstime_private.h"
 #include "lstime_tests.h"
@@ -176,6 +178,132 @@ static bool test_percentile(void) {
     return true;
 }
 
+static bool test_compiled_literals(void) {
+    lstime_info info;
+    memset(&info, 0, sizeof(info));
+    info.path = "p";
+
+    lstime_item_prog *prog = lstime_compile_item_format("<%r>%n%%%r%%");
+    du_assert_int_eq(prog->num_ops, 5, "literal runs are merged");
+    FILE *fp = open_mem();
+    lstime_writer out;
+    lstime_writer_init_fp(&out, fp, 64);
+    lstime_run_item_prog(&out, &info, prog, "", true, false);
+    lstime_free_item_prog(prog);
+    lstime_writer_finit(&out);
+    const char *str = close_and_get_mem(fp);
+    du_assert_str_eq(str, "<p>\n%p%", "compiled item format");
+    free_mem();
+    return true;
+}
+
+static bool test_writer_boundaries(void) {
+    FILE *fp = open_mem();
+    lstime_writer out;
+    lstime_writer_init_fp(&out, fp, 8);
+    lstime_writer_puts(&out, "abcde");         // buffered
+    lstime_writer_puts(&out, "fghij");         // drains, then buffered
+    lstime_writer_puts(&out, "0123456789AB");  // larger than the buffer
+    lstime_writer_write(&out, "", 0);
+    lstime_writer_puts(&out, "xyz");
+    lstime_writer_finit(&out);
+    const char *str = close_and_get_mem(fp);
+    du_assert_str_eq(str, "abcdefghij0123456789ABxyz", "writer keeps order");
+    free_mem();
+    return true;
+}
+
+// --sort arg through the option parser
+static void parse_sort(lstime_options *opts, const char *sort_arg) {
+    char prog[] = "lstime";
+    char opt[] = "--sort";
+    char arg[64];
+    snprintf(arg, sizeof(arg), "%s", sort_arg);
+    char *argv[] = { prog, opt, arg, NULL };
+    lstime_set_option_defaults(opts);
+    optind = 0;  // restart getopt
+    lstime_parse_options(opts, 3, argv);
+    lstime_free_item_prog((lstime_item_prog *) opts->item_prog);
+    opts->item_prog = NULL;
+}
+
+// exit status of parsing a --sort arg the parser rejects (with exit)
+static int parse_sort_status(const char *sort_arg) {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (freopen("/dev/null", "w", stderr) == NULL) {
+            _exit(98);
+        }
+        lstime_options opts;
+        parse_sort(&opts, sort_arg);
+        _exit(99);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+static bool test_sort_keys(void) {
+    lstime_options opts;
+    parse_sort(&opts, "mtime,path");
+    du_assert_int_eq(opts.sort_field, 'm', "first key of mtime,path");
+    du_assert_str_eq(opts.sort_keys, "mp", "keys of mtime,path");
+    parse_sort(&opts, "m,p");
+    du_assert_str_eq(opts.sort_keys, "mp", "single letter keys");
+    parse_sort(&opts, "ctime,a,btime,m,p");
+    du_assert_str_eq(opts.sort_keys, "cabmp", "all five keys");
+    parse_sort(&opts, "path");
+    du_assert_int_eq(opts.sort_field, 'p', "single key");
+    du_assert_true(!SORT_IS_COMPOUND(&opts), "single key is not compound");
+    parse_sort(&opts, "none");
+    du_assert_int_eq(opts.sort_field, 'n', "none");
+
+    parse_sort(&opts, "a,path");
+    FILE *fp = open_mem();
+    lstime_show_option_settings(&opts, fp);
+    const char *str = close_and_get_mem(fp);
+    du_assert_true(strstr(str, "--sort=a,p\n") != NULL, "show options lists keys");
+    free_mem();
+
+    du_assert_int_eq(parse_sort_status("m,m"), 2, "duplicate key");
+    du_assert_int_eq(parse_sort_status("mtime,m"), 2, "duplicate key, long and short");
+    du_assert_int_eq(parse_sort_status("p,none"), 2, "none in a list");
+    du_assert_int_eq(parse_sort_status("none,p"), 2, "none first in a list");
+    du_assert_int_eq(parse_sort_status("m,"), 2, "empty trailing field");
+    du_assert_int_eq(parse_sort_status(",m"), 2, "empty leading field");
+    du_assert_int_eq(parse_sort_status("mtime,paths"), 2, "unknown key");
+    return true;
+}
+
+// options that skipped the parser have no compiled item format
+static bool test_uncompiled_item_format(void) {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (freopen("/dev/null", "w", stderr) == NULL) {
+            _exit(98);
+        }
+        lstime_options opts;
+        lstime_set_option_defaults(&opts);
+        lstime_info info;
+        memset(&info, 0, sizeof(info));
+        info.path = "no path";
+        FILE *fp = open_mem();
+        lstime_writer out;
+        lstime_writer_init_fp(&out, fp, 64);
+        lstime_output_item(&out, &info, &opts);
+        _exit(99);
+    }
+    int status = 0;
+    du_assert_true(pid > 0 && waitpid(pid, &status, 0) == pid &&
+                   WIFEXITED(status), "child exited");
+    du_assert_int_eq(WEXITSTATUS(status), 51, "uncompiled item format");
+    return true;
+}
+
 int output_item_suite(void) {
     du_add(test_mtime());
     du_add(test_atime());
@@ -187,6 +315,10 @@ int output_item_suite(void) {
     du_add(test_zero());
     du_add(test_newline());
     du_add(test_percentile());
+    du_add(test_compiled_literals());
+    du_add(test_writer_boundaries());
+    du_add(test_sort_keys());
+    du_add(test_uncompiled_item_format());
     return du_suite_summary("lstime_output_item Test Suite Summary");
 }
 
@@ -4,10 +4,11 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <unistd.h>
 
 #include "lstime_private.h"
 
-static const char *usage_fmt = "\nUsage:  %s [options] [path ...]\n%s%s";
+static const char *usage_fmt = "\nUsage:  %s [options] [path ...]\n%s%s%s";
 static const char *usage1 =
 "\n"
 "Description:  Display a file's associated timestamps.\n"
@@ -20,9 +21,16 @@ static const char *usage1 =
 "   -f, --file={filename}     read pathnames from file (use - for stdin)\n"
 "   -n, --newline             read paths with newline termination (default)\n"
 "   -z, --null                read paths with nul-termination\n"
+"   -R, --recursive           also list everything below directory paths\n"
 "   -o, --show-options        show option settings (including defaults)\n"
 "   -r, --reverse             reverse sorting order\n"
-"   -s, --sort={field}        sort by field (default is newest first)\n"
+"   -s, --sort={field}        sort by field(s) (default is newest first)\n"
+"   -N, --limit={n}           only output the first n items (default 0, all)\n"
+"   -M, --max-memory={n}      sort in runs on disk beyond n bytes, K/M/G ok\n"
+"   -j, --jobs={n}            stat paths with n parallel threads (default 1)\n"
+"   -I, --io-engine={engine}  sync (default) or uring, see below\n"
+"   -Q, --queue-depth={n}     statx requests in flight for uring (default 128)\n"
+"   -W, --write-buffer={n}    output buffer size, K/M/G suffix ok (default 256K)\n"
 "   -d, --debug               show some debug messages\n"
 "   -v, --version             show version info\n"
 "   -h, --help                show this usage help\n"
@@ -59,11 +67,18 @@ static const char *usage2 =
 "      m[time] | a[time] | c[time] | b[time] | p[ath] | n[one] (default)\n"
 "      Times are by default sorted most recent first.\n"
 "      Sort order can be reversed with -r/--reverse.\n"
+"      Several fields, like '--sort mtime,path', sort by the first field,\n"
+"      then by the next one for items that are equal so far.\n"
 "      Note that sorting buffers all output, which can use lots of memory.\n"
 "      But '--sort none' will not buffer and is preferred when processing\n"
 "      large inputs (like from find).\n"
+"      With -N/--limit, only the first n items in sort order are buffered,\n"
+"      like '| head -n' but using memory for only n items.\n"
+"      With -M/--max-memory, sorted runs are spilled to temp files in\n"
+"      $TMPDIR (or /tmp) once the list would exceed about n bytes, and\n"
+"      merged for output.\n"
 "      Sorting by path uses the raw path and the current locale's collation.\n"
-"      Set LC_COLLATE=C to ignore the locale's collation.\n"
+"      Set LC_COLLATE=C to ignore the locale's collation (also faster).\n"
 "\n"
 "   The following are just convenience presets for some -i/-t settings:\n"
 "   -m, --mtime         mtime only\n"
@@ -90,6 +105,22 @@ static const char *usage2 =
 "   with %z after the raw path, e.g., -i '%m %r%z'.\n"
 "   Paths with escaping (%p and %u) do not really need nul-termination.\n"
 "\n"
+"   With -R/--recursive, each directory path is walked directly (no need\n"
+"   for find), listing a directory's entries before its subdirectories.\n"
+"   Symlinks to directories are only followed for the starting paths.\n"
+"   Combined with -j/--jobs, subdirectories are walked by parallel threads\n"
+"   and output order is unspecified (unless sorted).\n"
+"\n"
+"   With -j/--jobs greater than 1, paths are stat'ed concurrently, which\n"
+"   helps on slow or networked file systems. Without -R, output order is\n"
+"   unchanged. Large lists are also sorted with -j/--jobs threads.\n"
+"   Use -j 0 for one thread per online CPU.\n"
+"   With -I/--io-engine=uring, a single thread keeps up to -Q/--queue-depth\n"
+"   statx requests in flight through io_uring(7), submitted in batches.\n"
+"   If io_uring is unavailable, the sync engine is used instead.\n"
+"\n";
+
+static const char *usage3 =
 "   To use a timezone (other than local (-l) or UTC (-u), set the\n" 
 "   TZ environment variable. Note that TZ uses UTC offsets with the\n"
 "   sign reversed from ISO 8601 offsets. For example, Eastern Standard\n"
@@ -134,7 +165,7 @@ static const char *usage2 =
 "   When (or if) atime gets updated depends upon fs mount options.\n"
 "\n";
 
-static const char *short_opts = "+:abcdef:hi:lmnors:t:uvzABLPXYZ";
+static const char *short_opts = "+:abcdef:hi:j:lmnors:t:uvzABI:LM:N:PQ:RW:XYZ";
 
 static struct option long_opts[] = {
     { "atime",            no_argument,       NULL, 'a'},
@@ -145,6 +176,7 @@ static struct option long_opts[] = {
     { "file",             required_argument, NULL, 'f'},
     { "help",             no_argument,       NULL, 'h'},
     { "item-format",      required_argument, NULL, 'i'},
+    { "jobs",             required_argument, NULL, 'j'},
     { "local-time",       no_argument,       NULL, 'l'},
     { "mtime",            no_argument,       NULL, 'm'},
     { "newline",          no_argument,       NULL, 'n'},
@@ -157,8 +189,14 @@ static struct option long_opts[] = {
     { "null",             no_argument,       NULL, 'z'},
     { "automount",        no_argument,       NULL, 'A'},
     { "no-automount",     no_argument,       NULL, 'B'},
+    { "io-engine",        required_argument, NULL, 'I'},
     { "follow-links",     no_argument,       NULL, 'L'},
+    { "max-memory",       required_argument, NULL, 'M'},
+    { "limit",            required_argument, NULL, 'N'},
     { "stat-links",       no_argument,       NULL, 'P'},
+    { "queue-depth",      required_argument, NULL, 'Q'},
+    { "recursive",        no_argument,       NULL, 'R'},
+    { "write-buffer",     required_argument, NULL, 'W'},
     { "sync-as-stat",     no_argument,       NULL, 'X'},
     { "force-sync",       no_argument,       NULL, 'Y'},
     { "do-not-sync",      no_argument,       NULL, 'Z'},
@@ -174,13 +212,93 @@ static const char *long_from_short(int short_opt) {
     return "";
 }
 
+static long parse_count_arg(int short_opt, const char *arg, long min, long max) {
+    char *end = NULL;
+    errno = 0;
+    long val = strtol(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || val < min || val > max) {
+        err("invalid --%s value: %s (expected %ld to %ld)",
+            long_from_short(short_opt), arg, min, max);
+        exit(2);
+    }
+    return val;
+}
+
+// a byte count with an optional K, M or G (binary) suffix
+static size_t parse_size_arg(int short_opt, const char *arg, size_t min, size_t max) {
+    char *end = NULL;
+    errno = 0;
+    unsigned long long val = strtoull(arg, &end, 10);
+    unsigned shift = 0;
+    if (end != arg && *end != '\0' && end[1] == '\0') {
+        switch (*end) {
+            case 'k': case 'K': shift = 10; ++end; break;
+            case 'm': case 'M': shift = 20; ++end; break;
+            case 'g': case 'G': shift = 30; ++end; break;
+        }
+    }
+    if (errno != 0 || end == arg || *end != '\0' || arg[0] == '-' ||
+        val > (max >> shift) || (val << shift) < min) {
+        err("invalid --%s value: %s (expected %zu to %zu)",
+            long_from_short(short_opt), arg, min, max);
+        exit(2);
+    }
+    return (size_t) (val << shift);
+}
+
+static int sort_letter(const char *name, size_t len) {
+    static const char *names[] = { "mtime", "atime", "ctime", "btime", "path", "none" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (len == 1 ? (name[0] == names[i][0]) :
+            (strlen(names[i]) == len && strncmp(name, names[i], len) == 0)) {
+            return names[i][0];
+        }
+    }
+    return 0;
+}
+
+// a field, or comma separated fields for a compound key (like mtime,path)
+static void parse_sort_arg(lstime_options *opts, const char *arg) {
+    char keys[LSTIME_MAX_SORT_KEYS + 1] = "";
+    size_t num_keys = 0;
+    for (const char *name = arg; ; ) {
+        size_t len = strcspn(name, ",");
+        int letter = sort_letter(name, len);
+        if (letter == 0) {
+            err("unknown --sort value: %s\n", arg);
+            exit(2);
+        }
+        if (strchr(keys, letter) != NULL ||
+            (letter == 'n' && name != arg) || (num_keys > 0 && keys[0] == 'n')) {
+            err("bad --sort key list: %s\n", arg);
+            exit(2);
+        }
+        keys[num_keys++] = (char) letter;  // at most one of each
+        if (name[len] == '\0') {
+            break;
+        }
+        name += len + 1;
+    }
+    opts->sort_field = keys[0];
+    memcpy(opts->sort_keys, keys, sizeof(keys));
+}
+
 void lstime_set_option_defaults(lstime_options *opts) {
     opts->item_format = "%m  %a  %p%n";
+    opts->item_prog = NULL;
     opts->time_format = "%FT%T.%3N";
     opts->path_input_file = NULL;
     opts->stat_flags = AT_STATX_SYNC_AS_STAT; // also defaults to follow, automount
     opts->sort_field = 'n';
+    memset(opts->sort_keys, 0, sizeof(opts->sort_keys));
+    opts->jobs = 1;
+    opts->io_engine = 's';
+    opts->queue_depth = 128;
+    opts->write_buffer_size = 256 * 1024;
+    opts->limit = 0;
+    opts->max_memory = 0;
     opts->reverse = false;
+    opts->recursive = false;
     opts->path_input_file_delim = '\n';
     opts->format_time_as_utc = false;
     opts->debug = false;
@@ -208,10 +326,23 @@ void lstime_show_option_settings(const lstime_options *opts, FILE *fp) {
         fprintf(fp, "--do-not-sync\n");
     }
 
-    fprintf(fp, "--sort=%c\n", opts->sort_field);
+    fprintf(fp, "--sort=%c", opts->sort_field);
+    for (int i = 1; i < LSTIME_MAX_SORT_KEYS && opts->sort_keys[i] != '\0'; ++i) {
+        fprintf(fp, ",%c", opts->sort_keys[i]);
+    }
+    fprintf(fp, "\n");
+    fprintf(fp, "--limit=%zu\n", opts->limit);
+    fprintf(fp, "--max-memory=%zu\n", opts->max_memory);
+    fprintf(fp, "--jobs=%d\n", opts->jobs);
+    fprintf(fp, "--io-engine=%s\n", (opts->io_engine == 'u') ? "uring" : "sync");
+    fprintf(fp, "--queue-depth=%d\n", opts->queue_depth);
+    fprintf(fp, "--write-buffer=%zu\n", opts->write_buffer_size);
     if (opts->reverse) {
         fprintf(fp, "--reverse\n");
     }
+    if (opts->recursive) {
+        fprintf(fp, "--recursive\n");
+    }
     if (opts->path_input_file_delim == '\n') {
         fprintf(fp, "--newline\n");
     } else if (opts->path_input_file_delim == '\0') {
@@ -259,6 +390,13 @@ void lstime_parse_options(lstime_options *opts, int argc, char *argv[]) {
         case 'i':   //  --item-format
             opts->item_format = optarg;
             break;
+        case 'j':   //  --jobs
+            opts->jobs = parse_count_arg(opt, optarg, 0, MAX_JOBS);
+            if (opts->jobs == 0) {
+                long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+                opts->jobs = (ncpu < 1) ? 1 : (ncpu > MAX_JOBS) ? MAX_JOBS : ncpu;
+            }
+            break;
         case 'l':   //  --local-time
             opts->format_time_as_utc = false;
             break;
@@ -275,28 +413,7 @@ void lstime_parse_options(lstime_options *opts, int argc, char *argv[]) {
             opts->reverse = !opts->reverse;  // flips/toggles 
             break;
         case 's':   //  --sort
-            if (strcmp(optarg, "m") == 0 ||
-                strcmp(optarg, "mtime") == 0) {
-                opts->sort_field = 'm';
-            } else if (strcmp(optarg, "a") == 0 ||
-                       strcmp(optarg, "atime") == 0) {
-                opts->sort_field = 'a';
-            } else if (strcmp(optarg, "c") == 0 ||
-                       strcmp(optarg, "ctime") == 0) {
-                opts->sort_field = 'c';
-            } else if (strcmp(optarg, "b") == 0 ||
-                       strcmp(optarg, "btime") == 0) {
-                opts->sort_field = 'b';
-            } else if (strcmp(optarg, "p") == 0 ||
-                       strcmp(optarg, "path") == 0) {
-                opts->sort_field = 'p';
-            } else if (strcmp(optarg, "n") == 0 ||
-                       strcmp(optarg, "none") == 0) {
-                opts->sort_field = 'n';
-            } else {
-                err("unknown --sort value: %s\n", optarg);
-                exit(2);
-            }
+            parse_sort_arg(opts, optarg);
             break;
         case 't':   //  --time-format
             opts->time_format = optarg;
@@ -318,12 +435,42 @@ void lstime_parse_options(lstime_options *opts, int argc, char *argv[]) {
         case 'B':   //  --no-automount
             opts->stat_flags |= AT_NO_AUTOMOUNT;
             break;
+        case 'I':   //  --io-engine
+            if (strcmp(optarg, "sync") == 0) {
+                opts->io_engine = 's';
+            } else if (strcmp(optarg, "uring") == 0 ||
+                       strcmp(optarg, "io_uring") == 0) {
+                opts->io_engine = 'u';
+            } else {
+                err("unknown --io-engine value: %s", optarg);
+                exit(2);
+            }
+            break;
         case 'L':   //  --follow-links
             opts->stat_flags &= ~AT_SYMLINK_NOFOLLOW;
             break;
+        case 'M':   //  --max-memory
+            opts->max_memory = parse_size_arg(opt, optarg,
+                                              MIN_MAX_MEMORY,
+                                              MAX_MAX_MEMORY);
+            break;
+        case 'N':   //  --limit
+            opts->limit = parse_count_arg(opt, optarg, 0, MAX_LIMIT);
+            break;
         case 'P':   //  --stat-links
             opts->stat_flags |= AT_SYMLINK_NOFOLLOW;
             break;
+        case 'Q':   //  --queue-depth
+            opts->queue_depth = parse_count_arg(opt, optarg, 1, MAX_QUEUE_DEPTH);
+            break;
+        case 'R':   //  --recursive
+            opts->recursive = true;
+            break;
+        case 'W':   //  --write-buffer
+            opts->write_buffer_size = parse_size_arg(opt, optarg,
+                                                     MIN_WRITE_BUFFER,
+                                                     MAX_WRITE_BUFFER);
+            break;
         case 'X':   //  --sync-as-stat
             opts->stat_flags &= ~AT_STATX_SYNC_TYPE;
             opts->stat_flags |= AT_STATX_SYNC_AS_STAT;
@@ -337,7 +484,7 @@ void lstime_parse_options(lstime_options *opts, int argc, char *argv[]) {
             opts->stat_flags |= AT_STATX_DONT_SYNC;
             break;
         case 'h':   //  --help
-            fprintf(stdout, usage_fmt, pgm, usage1, usage2);
+            fprintf(stdout, usage_fmt, pgm, usage1, usage2, usage3);
             exit(0);
             break;
         case ':':
@@ -355,5 +502,8 @@ void lstime_parse_options(lstime_options *opts, int argc, char *argv[]) {
             break;
         }
     }
+
+    // compile once here instead of parsing the format for every item
+    opts->item_prog = lstime_compile_item_format(opts->item_format);
 }
 
@@ -0,0 +1,94 @@
+// SPDX-FileCopyrightText: © 2023 Daniel D. Mickey III
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "lstime_private.h"
+
+// Finds where a path first needs a closer look for quoting.  The "plain"
+// bytes are the ones most paths are made of and that never need quoting:
+// 0-9, A-Z, a-z and + , - . / : @ _ (all other bytes, even ones that turn
+// out to be fine, are left to the caller's full classification).  Blocks
+// of 32 (AVX2, when the CPU has it) or 16 (SSE2) bytes are checked with a
+// few range compares, and the rest of the path byte by byte.
+
+static inline bool is_plain(unsigned char c) {
+    return (unsigned char) (c - 0x2B) <= 0x3A - 0x2B ||   // + , - . / 0-9 :
+        (unsigned char) (c - 0x40) <= 0x5A - 0x40 ||      // @ A-Z
+        (unsigned char) (c - 0x61) <= 0x7A - 0x61 ||      // a-z
+        c == '_';
+}
+
+static size_t scalar_span(const char *str, size_t len) {
+    size_t i = 0;
+    while (i < len && is_plain((unsigned char) str[i])) {
+        ++i;
+    }
+    return i;
+}
+
+#ifdef __SSE2__
+// lanes of v in [lo, hi] set to all ones
+static inline __m128i in_range_16(__m128i v, char lo, char hi) {
+    __m128i x = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8((char) (hi - lo))), x);
+}
+
+static size_t sse2_span(const char *str, size_t len) {
+    size_t i = 0;
+    for ( ; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (str + i));
+        __m128i plain = _mm_or_si128(
+            _mm_or_si128(in_range_16(v, 0x2B, 0x3A), in_range_16(v, 0x40, 0x5A)),
+            _mm_or_si128(in_range_16(v, 0x61, 0x7A), _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))));
+        unsigned mask = ~(unsigned) _mm_movemask_epi8(plain) & 0xFFFF;
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scalar_span(str + i, len - i);
+}
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_AVX2_SPAN 1
+
+__attribute__((target("avx2")))
+static inline __m256i in_range_32(__m256i v, char lo, char hi) {
+    __m256i x = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8((char) (hi - lo))), x);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_span(const char *str, size_t len) {
+    size_t i = 0;
+    for ( ; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (str + i));
+        __m256i plain = _mm256_or_si256(
+            _mm256_or_si256(in_range_32(v, 0x2B, 0x3A), in_range_32(v, 0x40, 0x5A)),
+            _mm256_or_si256(in_range_32(v, 0x61, 0x7A),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))));
+        unsigned mask = ~(unsigned) _mm256_movemask_epi8(plain);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + sse2_span(str + i, len - i);
+}
+#endif
+
+// number of plain bytes at the start of str (of len bytes)
+size_t lstime_plain_span(const char *str, size_t len) {
+#ifdef HAVE_AVX2_SPAN
+    if (__builtin_cpu_supports("avx2")) {
+        return avx2_span(str, len);
+    }
+#endif
+#ifdef __SSE2__
+    return sse2_span(str, len);
+#else
+    return scalar_span(str, len);
+#endif
+}
@@ -11,23 +11,88 @@
 #include "lstime.h"
 
 #define MAX_PATH_LEN 8192
-#define MAX_TIME_LEN 1024
+#define MAX_TIME_LEN LSTIME_MAX_TIME_LEN
+#define MAX_JOBS 256
+#define MIN_WRITE_BUFFER 512
+#define MAX_WRITE_BUFFER ((size_t) 1 << 30)
+#define MAX_QUEUE_DEPTH 4096
+#define MIN_MAX_MEMORY ((size_t) 1 << 20)
+#define MAX_MAX_MEMORY ((size_t) 1 << 50)
+#define MAX_LIMIT ((long) UINT32_MAX - 1)  // items are indexed in 32 bits
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
 
 #define SET_TIMESPEC_EMPTY(ts_ptr) \
     { (ts_ptr)->tv_sec = -1; (ts_ptr)->tv_nsec = -1; }
 #define HAS_TIMESPEC(ts_ptr) \
     ((ts_ptr)->tv_sec != -1 && (ts_ptr)->tv_nsec != -1)
+#define SORT_IS_COMPOUND(opts) ((opts)->sort_keys[1] != '\0')
+
+#define POOL_SYNC    0  // io_uring fallback with a single job
+#define POOL_THREADS 1
+#define POOL_URING   2
 
 #define err(...) lstime_err(__VA_ARGS__)
 #define warn(...) lstime_warn(__VA_ARGS__)
 #define msg(...) lstime_msg(__VA_ARGS__)
 
-iconv_t lstime_iconv_init(void);  // not really needed, as called automatically
-bool lstime_iconv(const char *path, bool debug);
-uint32_t *lstime_outbuf(void);
-size_t lstime_outbuf_len(void);
-size_t lstime_outbuf_capacity(void);
-void lstime_iconv_finit(void);    // free up some resources
+size_t lstime_plain_span(const char *str, size_t len);  // never need quoting
+int lstime_utf8_decode(const char *str, size_t len, uint32_t *cp);  // 0 if invalid
+size_t lstime_utf8_valid_len(const char *str, size_t len);
+
+struct statx;
+typedef struct lstime_uring lstime_uring;
+unsigned int lstime_statx_mask(void);
+int lstime_stat_pool_mode(const lstime_options *opts, bool have_ring);
+void lstime_stat_path_finit(void);  // per thread, closes the cached dir fds
+void lstime_tz_cache_reset(void);   // per thread, call after TZ changes
+lstime_format_ctx *lstime_thread_format_ctx(void);  // for the non-_r formatters
+void lstime_info_from_statx(lstime_info *info, const struct statx *stxbuf);
+lstime_uring *lstime_uring_open(unsigned entries);  // NULL if unavailable
+void lstime_uring_disable(bool disable);  // for tests, as if unavailable
+void lstime_uring_close(lstime_uring *ring);
+unsigned lstime_uring_capacity(const lstime_uring *ring);
+bool lstime_uring_statx(lstime_uring *ring,
+                        int dirfd,
+                        const char *path,
+                        int flags,
+                        unsigned int mask,
+                        struct statx *buf,
+                        uint64_t user_data);
+int lstime_uring_submit(lstime_uring *ring, unsigned wait_nr);
+bool lstime_uring_reap(lstime_uring *ring, uint64_t *user_data, int *res);
+char *lstime_arena_alloc(lstime_arena *a, size_t size);  // unaligned
+char *lstime_arena_strdup(lstime_arena *a, const char *str);
+void lstime_arena_reset(lstime_arena *a);
+void lstime_arena_free(lstime_arena *a);
+int lstime_field_index(int field);  // 0 to 3 for m, a, c, b; else -1
+unsigned lstime_list_fields(const lstime_options *opts);
+void lstime_list_permute(arr_wrapper *list, const size_t *order);
+void lstime_list_end_limit(arr_wrapper *list);  // before sorting
+const char *lstime_path_sortkey(const char *path);
+const char *lstime_compound_sortkey(const lstime_info *info,
+                                    const lstime_options *opts,
+                                    bool bytes);  // lstime_collate_is_bytes()
+bool lstime_collate_is_bytes(void);
+void lstime_collate_override(int bytes);  // for tests, -1 for the locale
+typedef void (*lstime_psort_sort_fn)(void *base, size_t n, void *scratch, void *ctx);
+typedef int (*lstime_psort_comp_fn)(const void *a, const void *b, void *ctx);
+void lstime_parallel_sort(void *base,      // elements must never compare equal
+                          size_t n,
+                          size_t size,
+                          void *scratch,   // n elements
+                          int threads,
+                          lstime_psort_sort_fn sort_piece,
+                          lstime_psort_comp_fn comp,
+                          void *ctx);
+bool lstime_limit_reached(const arr_wrapper *list,
+                          const lstime_options *opts,
+                          size_t pending);
+void lstime_spill_reserve(arr_wrapper *list, const lstime_options *opts);
+bool lstime_spill_finish(lstime_writer *out,
+                         arr_wrapper *list,
+                         const lstime_options *opts);
 void lstime_set_prog(const char *pgm);  // for lstime_msg messages
 const char *lstime_get_prog(void);
 __attribute__((__format__(__printf__, 1, 2)))
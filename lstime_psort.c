@@ -0,0 +1,196 @@
+// SPDX-FileCopyrightText: © 2023 Daniel D. Mickey III
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <pthread.h>
+
+#include "lstime_private.h"
+
+// Parallel sort for large lists: the array is cut into one piece per
+// thread, the pieces are sorted concurrently with the single-threaded
+// sort, and then merged pairwise, round by round, between the array and
+// a scratch array of the same size.  Every merge is cut into slices of
+// about equal output size with merge path (a binary search along the
+// output diagonal), so the last rounds, with only one or two big merges,
+// still keep all threads busy.  Elements must never compare equal (the
+// callers break ties by index), so no care is needed for stability.
+
+#define MAX_TASKS (4 * MAX_JOBS)
+
+typedef struct merge_task {
+    const char *a;      // first run
+    size_t na;
+    const char *b;      // second run, may be empty
+    size_t nb;
+    char *dst;          // start of the merged output for this pair
+    size_t d0;          // output range of this slice
+    size_t d1;
+} merge_task;
+
+typedef struct psort_state {
+    char *base;
+    size_t size;
+    lstime_psort_sort_fn sort_piece;
+    lstime_psort_comp_fn comp;
+    void *ctx;
+    size_t bounds[MAX_JOBS + 1];  // piece boundaries
+    char *scratch;
+    merge_task tasks[MAX_TASKS];
+    size_t num_tasks;
+    size_t next_task;             // claimed atomically
+} psort_state;
+
+typedef struct psort_worker {
+    psort_state *st;
+    int id;
+} psort_worker;
+
+// how many elements of a go before the output diagonal d of merge(a, b)
+static size_t merge_path(const psort_state *st, const merge_task *t, size_t d) {
+    size_t lo = (d > t->nb) ? d - t->nb : 0;
+    size_t hi = MIN(d, t->na);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (st->comp(t->a + mid * st->size,
+                     t->b + (d - mid - 1) * st->size, st->ctx) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void merge_slice(const psort_state *st, const merge_task *t) {
+    size_t size = st->size;
+    size_t i = merge_path(st, t, t->d0);
+    size_t j = t->d0 - i;
+    char *out = t->dst + t->d0 * size;
+    for (size_t d = t->d0; d < t->d1; ++d, out += size) {
+        if (j >= t->nb ||
+            (i < t->na && st->comp(t->a + i * size, t->b + j * size, st->ctx) < 0)) {
+            memcpy(out, t->a + i * size, size);
+            ++i;
+        } else {
+            memcpy(out, t->b + j * size, size);
+            ++j;
+        }
+    }
+}
+
+static void *sort_worker(void *arg) {
+    psort_worker *w = arg;
+    psort_state *st = w->st;
+    size_t lo = st->bounds[w->id];
+    size_t hi = st->bounds[w->id + 1];
+    st->sort_piece(st->base + lo * st->size, hi - lo,
+                   st->scratch + lo * st->size, st->ctx);
+    return NULL;
+}
+
+static void *merge_worker(void *arg) {
+    psort_worker *w = arg;
+    psort_state *st = w->st;
+    for (;;) {
+        size_t k = __atomic_fetch_add(&st->next_task, 1, __ATOMIC_RELAXED);
+        if (k >= st->num_tasks) {
+            break;
+        }
+        merge_slice(st, &st->tasks[k]);
+    }
+    return NULL;
+}
+
+static void run_workers(psort_state *st, int threads, void *(*fn)(void *)) {
+    pthread_t tids[MAX_JOBS];
+    psort_worker workers[MAX_JOBS];
+    for (int i = 0; i < threads; ++i) {
+        workers[i].st = st;
+        workers[i].id = i;
+        int rc = pthread_create(&tids[i], NULL, fn, &workers[i]);
+        if (rc != 0) {
+            err("pthread_create: %s", strerror(rc));
+            exit(41);
+        }
+    }
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(tids[i], NULL);
+    }
+}
+
+// plan one round: merge runs 2k and 2k+1 of src into dst, in slices
+static void plan_round(psort_state *st, char *src, char *dst,
+                       int num_runs, size_t n, int threads) {
+    st->num_tasks = 0;
+    st->next_task = 0;
+    for (int r = 0; r < num_runs; r += 2) {
+        size_t lo = st->bounds[r];
+        size_t mid = st->bounds[r + 1];
+        size_t hi = (r + 1 < num_runs) ? st->bounds[r + 2] : mid;
+        size_t len = hi - lo;
+        size_t slices = MAX(1, (size_t) threads * len / n);
+        slices = MIN(slices, MAX_TASKS - st->num_tasks - (num_runs - r) / 2);
+        slices = MAX(slices, 1);
+        for (size_t s = 0; s < slices; ++s) {
+            merge_task *t = &st->tasks[st->num_tasks++];
+            t->a = src + lo * st->size;
+            t->na = mid - lo;
+            t->b = src + mid * st->size;
+            t->nb = hi - mid;
+            t->dst = dst + lo * st->size;
+            t->d0 = len * s / slices;
+            t->d1 = len * (s + 1) / slices;
+        }
+    }
+}
+
+// sorts base (n elements of size bytes) using scratch of the same size
+void lstime_parallel_sort(void *base,
+                          size_t n,
+                          size_t size,
+                          void *scratch,
+                          int threads,
+                          lstime_psort_sort_fn sort_piece,
+                          lstime_psort_comp_fn comp,
+                          void *ctx) {
+    threads = MAX(1, MIN(threads, MAX_JOBS));
+    if (threads == 1 || n < (size_t) threads) {
+        sort_piece(base, n, scratch, ctx);
+        return;
+    }
+    psort_state *st = calloc(1, sizeof(psort_state));
+    if (st == NULL) {
+        err("sort out of memory: %s", strerror(errno));
+        exit(48);
+    }
+    st->base = base;
+    st->size = size;
+    st->sort_piece = sort_piece;
+    st->comp = comp;
+    st->ctx = ctx;
+    st->scratch = scratch;
+    for (int i = 0; i <= threads; ++i) {
+        st->bounds[i] = n * i / threads;
+    }
+    run_workers(st, threads, sort_worker);
+
+    char *src = base;
+    char *dst = scratch;
+    int num_runs = threads;
+    while (num_runs > 1) {
+        plan_round(st, src, dst, num_runs, n, threads);
+        run_workers(st, threads, merge_worker);
+        int runs = 0;   // the merged runs start at every other boundary
+        for (int r = 0; r < num_runs; r += 2) {
+            st->bounds[runs++] = st->bounds[r];
+        }
+        st->bounds[runs] = n;
+        num_runs = runs;
+        char *t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != base) {
+        memcpy(base, src, n * size);
+    }
+    free(st);
+}
@@ -1,106 +1,631 @@
 // SPDX-FileCopyrightText: © 2023 Daniel D. Mickey III
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include <locale.h>
+
 #include "lstime_private.h"
 
+// lists at least this long sort times with the radix sort below
+#define RADIX_MIN_ELEMS 256
+
+// bytes of each path's collation key kept for sorting in real locales
+#define KEY_PREFIX_LEN 24
+
+// runs at least this long on average are merged instead of sorted
+#define NATURAL_MIN_RUN 32
+
+// lists at least this long are sorted by up to opts->jobs threads, each
+// given at least a quarter of it
+#define PARALLEL_MIN_ELEMS (64 * 1024)
+
+// Sorting never moves the list columns themselves: a compact array of
+// (key, index) entries is sorted, and the columns are permuted into that
+// order once at the end.
+
+// Timestamp keys are a normalized 96-bit (sec, nsec) value.  sec has its
+// sign bit flipped so it orders as unsigned; nsec is shifted up by one so
+// the N/A sentinel (-1) orders just below 0.  Descending (the default)
+// inverts the key.  The low 32 bits carry the element index, which also
+// makes equal times keep their input order.
+typedef struct time_entry {
+    uint64_t sec;   // high 64 bits of the key
+    uint64_t nsec;  // low 32 bits of the key, then the element index
+} time_entry;
+
+typedef struct path_entry {
+    const char *key;
+    size_t idx;
+} path_entry;
+
+// Path sorts in real locales only keep a prefix of each strxfrm key,
+// zero padded, and fall back to strcoll when two prefixes are equal.
+typedef struct prefix_entry {
+    char prefix[KEY_PREFIX_LEN];
+    const char *path;
+    size_t idx;
+} prefix_entry;
+
+static int comp_time_entry(const void *v1, const void *v2) {
+    const time_entry *e1 = v1;
+    const time_entry *e2 = v2;
+    if (e1->sec != e2->sec) {
+        return (e1->sec > e2->sec) ? 1 : -1;
+    }
+    return (e1->nsec > e2->nsec) - (e1->nsec < e2->nsec);
+}
+
+static int comp_prefix(const prefix_entry *e1, const prefix_entry *e2) {
+    int rc = memcmp(e1->prefix, e2->prefix, KEY_PREFIX_LEN);
+    if (rc == 0 && e1->prefix[KEY_PREFIX_LEN - 1] != '\0') {
+        rc = strcoll(e1->path, e2->path);  // keys may differ past the prefix
+    }
+    return rc;
+}
 
-// note descending time is the default for COMP_TIME
-// ascending time is the reverse 
-#define COMP_TIME(NAME, T1, T2)                         \
-    static int NAME(const void *v1, const void *v2) {   \
-        const lstime_info *info1 = v1;                  \
-        const lstime_info *info2 = v2;                  \
-        return comp_timespec((T2), (T1));               \
+static int comp_prefix_fwd(const void *v1, const void *v2) {
+    const prefix_entry *e1 = v1;
+    const prefix_entry *e2 = v2;
+    int rc = comp_prefix(e1, e2);
+    return (rc != 0) ? rc : (e1->idx > e2->idx) - (e1->idx < e2->idx);
 }
 
-#define COMP_PATH(NAME, P1, P2)                        \
-    static int NAME(const void *v1, const void *v2) {  \
-        const lstime_info *info1 = v1;                 \
-        const lstime_info *info2 = v2;                 \
-        return strcmp((P1), (P2));                     \
+static int comp_prefix_rev(const void *v1, const void *v2) {
+    const prefix_entry *e1 = v1;
+    const prefix_entry *e2 = v2;
+    int rc = comp_prefix(e2, e1);
+    return (rc != 0) ? rc : (e1->idx > e2->idx) - (e1->idx < e2->idx);
 }
 
-static int comp_timespec(const timespec *t1, const timespec *t2) {
-    if (t1->tv_sec > t2->tv_sec) {
+static int sort_threads(const lstime_options *opts, size_t n) {
+    if (opts->jobs <= 1 || n < PARALLEL_MIN_ELEMS) {
         return 1;
-    } else if (t1->tv_sec < t2->tv_sec) {
-        return -1;
     }
-    if (t1->tv_nsec > t2->tv_nsec) {
-        return 1;
-    } else if (t1->tv_nsec < t2->tv_nsec) {
-        return -1;
+    return (int) MIN((size_t) opts->jobs, n / (PARALLEL_MIN_ELEMS / 4));
+}
+
+static void *sort_alloc(size_t n, size_t size) {
+    void *ptr = reallocarray(NULL, n, size);
+    if (ptr == NULL) {
+        err("sort out of memory: %s", strerror(errno));
+        exit(48);
     }
-    return 0;
+    return ptr;
 }
 
-COMP_TIME(comp_m_fwd, &info1->mtime, &info2->mtime)
-COMP_TIME(comp_m_rev, &info2->mtime, &info1->mtime)
-COMP_TIME(comp_a_fwd, &info1->atime, &info2->atime)
-COMP_TIME(comp_a_rev, &info2->atime, &info1->atime)
-COMP_TIME(comp_c_fwd, &info1->ctime, &info2->ctime)
-COMP_TIME(comp_c_rev, &info2->ctime, &info1->ctime)
-COMP_TIME(comp_b_fwd, &info1->btime, &info2->btime)
-COMP_TIME(comp_b_rev, &info2->btime, &info1->btime)
+// Presorted input (like find output sorted by path, or what lstime wrote
+// before) is mostly left as it is: the entries are scanned for ascending
+// and descending runs, descending runs are reversed in place, and when
+// the runs are long enough on average they are merged pairwise, so sorted
+// input costs a single pass.  Otherwise the scan gives up after looking
+// at a small part of the entries, which are then sorted as usual.
+// Entries never compare equal (ties go by index), but descending runs are
+// found by key alone, and equal keys are put back in index order.
 
-COMP_PATH(comp_p_fwd, info1->sortkey, info2->sortkey)
-COMP_PATH(comp_p_rev, info2->sortkey, info1->sortkey)
+static void reverse_entries(char *a, size_t lo, size_t hi, size_t size) {
+    char tmp[sizeof(prefix_entry)];  // the largest entry type
+    for (char *p = a + lo * size, *q = a + (hi - 1) * size; p < q; p += size, q -= size) {
+        memcpy(tmp, p, size);
+        memcpy(p, q, size);
+        memcpy(q, tmp, size);
+    }
+}
 
-void lstime_sort_list(arr_wrapper *list, const lstime_options *opts) {
-    if (list->num_elems == 0) {
+static void reverse_run(char *a, size_t lo, size_t hi, size_t size,
+                        lstime_psort_comp_fn comp_key, void *ctx) {
+    reverse_entries(a, lo, hi, size);
+    for (size_t k = lo; k < hi; ) {
+        size_t e = k + 1;
+        while (e < hi && comp_key(a + e * size, a + k * size, ctx) == 0) {
+            ++e;
+        }
+        reverse_entries(a, k, e, size);
+        k = e;
+    }
+}
+
+static void merge_pair(const char *src, char *dst, size_t lo, size_t mid, size_t hi,
+                       size_t size, lstime_psort_comp_fn comp, void *ctx) {
+    const char *a = src + lo * size;
+    const char *a_end = src + mid * size;
+    const char *b = a_end;
+    const char *b_end = src + hi * size;
+    char *out = dst + lo * size;
+    if (b == b_end || comp(b - size, b, ctx) < 0) {  // already in order
+        memcpy(out, a, (hi - lo) * size);
         return;
     }
+    while (a < a_end && b < b_end) {
+        if (comp(a, b, ctx) < 0) {
+            memcpy(out, a, size);
+            a += size;
+        } else {
+            memcpy(out, b, size);
+            b += size;
+        }
+        out += size;
+    }
+    memcpy(out, a, a_end - a);
+    memcpy(out + (a_end - a), b, b_end - b);
+}
 
-    static char buf[MAX_PATH_LEN];
-    if (opts->sort_field == 'p') {
-        // populate sortkey
-        lstime_info *ptr = list->arr;
-        lstime_info *end = ptr + list->num_elems;
-        for ( ; ptr < end ; ++ptr) {
-            size_t n = strxfrm(buf, ptr->path, sizeof(buf));
-            if (n >= sizeof(buf)) {
-                err("strxfrm exceeded buf len: %zu", sizeof(buf));
-                exit(39);
+// false if the entries are not presorted enough to merge their runs;
+// comp_key is comp without the tie break by index
+static bool natural_sort(void *base, size_t n, size_t size, void *scratch,
+                         lstime_psort_comp_fn comp, lstime_psort_comp_fn comp_key,
+                         void *ctx) {
+    char *a = base;
+    size_t max_runs = n / NATURAL_MIN_RUN + 1;
+    size_t *starts = sort_alloc(max_runs + 1, sizeof(size_t));
+    size_t runs = 0;
+    for (size_t i = 0; i < n; ) {
+        if (runs == max_runs) {
+            free(starts);
+            return false;
+        }
+        starts[runs++] = i;
+        size_t j = i + 1;
+        while (j < n && comp_key(a + j * size, a + (j - 1) * size, ctx) == 0) {
+            ++j;
+        }
+        if (j < n && comp_key(a + j * size, a + (j - 1) * size, ctx) < 0) {
+            for (++j; j < n && comp_key(a + j * size, a + (j - 1) * size, ctx) <= 0; ++j) {
             }
-            ptr->sortkey = strdup(buf);
-        }
-    }
-
-    int (*comp)(const void *, const void *) = NULL;
-    if (opts->reverse) {
-        if (opts->sort_field == 'm') {
-            comp = comp_m_rev;
-        } else if (opts->sort_field == 'a') {
-            comp = comp_a_rev;
-        } else if (opts->sort_field == 'c') {
-            comp = comp_c_rev;
-        } else if (opts->sort_field == 'b') {
-            comp = comp_b_rev;
-        } else if (opts->sort_field == 'p') {
-            comp = comp_p_rev;
+            reverse_run(a, i, j, size, comp_key, ctx);
         } else {
-            // n[one] should not appear here
-            err("sort_list: logic error / bad state");
-            exit(34);
+            for (j = i + 1; j < n && comp(a + j * size, a + (j - 1) * size, ctx) > 0; ++j) {
+            }
         }
-    } else {
-        if (opts->sort_field == 'm') {
-            comp = comp_m_fwd;
-        } else if (opts->sort_field == 'a') {
-            comp = comp_a_fwd;
-        } else if (opts->sort_field == 'c') {
-            comp = comp_c_fwd;
-        } else if (opts->sort_field == 'b') {
-            comp = comp_b_fwd;
-        } else if (opts->sort_field == 'p') {
-            comp = comp_p_fwd;
+        i = j;
+    }
+    starts[runs] = n;
+
+    if (runs > 1) {
+        char *buf = (scratch != NULL) ? scratch : sort_alloc(n, size);
+        char *src = a;
+        char *dst = buf;
+        while (runs > 1) {
+            size_t merged = 0;
+            for (size_t r = 0; r < runs; r += 2) {
+                size_t mid = starts[r + 1];
+                size_t hi = (r + 1 < runs) ? starts[r + 2] : mid;
+                merge_pair(src, dst, starts[r], mid, hi, size, comp, ctx);
+                starts[merged++] = starts[r];
+            }
+            starts[merged] = n;
+            runs = merged;
+            char *t = src;
+            src = dst;
+            dst = t;
+        }
+        if (src != a) {
+            memcpy(a, src, n * size);
+        }
+        if (buf != scratch) {
+            free(buf);
+        }
+    }
+    free(starts);
+    return true;
+}
+
+static void radix_pass(time_entry *src, time_entry *dst, size_t n,
+                       size_t *count, int byte) {
+    size_t sum = 0;
+    for (int d = 0; d < 256; ++d) {  // counts become starting positions
+        size_t c = count[d];
+        count[d] = sum;
+        sum += c;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t word = (byte < 8) ? src[i].nsec : src[i].sec;
+        unsigned d = (word >> ((byte % 8) * 8)) & 0xff;
+        dst[count[d]++] = src[i];
+    }
+}
+
+// LSD radix sort: O(n) with no comparator calls
+static time_entry *radix_sort_times(time_entry *a, time_entry *b, size_t n) {
+    // one read builds all the digit histograms; bytes 0-3 are the index,
+    // bytes 4-7 the nsec and 8-15 the sec
+    size_t counts[16][256];
+    memset(counts, 0, sizeof(counts));
+    for (size_t i = 0; i < n; ++i) {
+        for (int byte = 4; byte < 16; ++byte) {
+            uint64_t word = (byte < 8) ? a[i].nsec : a[i].sec;
+            ++counts[byte][(word >> ((byte % 8) * 8)) & 0xff];
+        }
+    }
+
+    for (int byte = 4; byte < 16; ++byte) {
+        // skip digits that are the same for every element
+        uint64_t word = (byte < 8) ? a[0].nsec : a[0].sec;
+        if (counts[byte][(word >> ((byte % 8) * 8)) & 0xff] == n) {
+            continue;
+        }
+        radix_pass(a, b, n, counts[byte], byte);
+        time_entry *t = a;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static int comp_time_piece(const void *v1, const void *v2, void *ctx) {
+    (void) ctx;
+    return comp_time_entry(v1, v2);
+}
+
+static int comp_time_key(const void *v1, const void *v2, void *ctx) {
+    (void) ctx;
+    const time_entry *e1 = v1;
+    const time_entry *e2 = v2;
+    if (e1->sec != e2->sec) {
+        return (e1->sec > e2->sec) ? 1 : -1;
+    }
+    return (e1->nsec >> 32 > e2->nsec >> 32) - (e1->nsec >> 32 < e2->nsec >> 32);
+}
+
+static void sort_time_piece(void *base, size_t n, void *scratch, void *ctx) {
+    time_entry *a = base;
+    if (natural_sort(a, n, sizeof(time_entry), scratch,
+                     comp_time_piece, comp_time_key, ctx)) {
+        return;
+    } else if (n < RADIX_MIN_ELEMS) {
+        qsort(a, n, sizeof(time_entry), comp_time_entry);
+    } else if (radix_sort_times(a, scratch, n) != a) {
+        memcpy(a, scratch, n * sizeof(time_entry));
+    }
+}
+
+static void sort_times(arr_wrapper *list, const lstime_options *opts) {
+    size_t n = list->num_elems;
+    int f = lstime_field_index(opts->sort_field);
+    if (f < 0 || list->secs[f] == NULL) {
+        // n[one] should not appear here
+        err("sort_list: logic error / bad state");
+        exit(34);
+    }
+    const int64_t *secs = list->secs[f];
+    const int32_t *nsecs = list->nsecs[f];
+    uint64_t invert = opts->reverse ? 0 : UINT64_MAX;  // descending default
+
+    // the second half is radix scratch space, then holds the order
+    time_entry *entries = sort_alloc(2 * n, sizeof(time_entry));
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t nsec = (uint32_t) (nsecs[i] + 1) ^ (uint32_t) invert;
+        entries[i].sec = ((uint64_t) secs[i] ^ ((uint64_t) 1 << 63)) ^ invert;
+        entries[i].nsec = (nsec << 32) | i;
+    }
+
+    time_entry *sorted = entries;
+    int threads = sort_threads(opts, n);
+    if (threads > 1) {
+        lstime_parallel_sort(entries, n, sizeof(time_entry), entries + n, threads,
+                             sort_time_piece, comp_time_piece, NULL);
+    } else if (!natural_sort(entries, n, sizeof(time_entry), entries + n,
+                             comp_time_piece, comp_time_key, NULL)) {
+        if (n >= RADIX_MIN_ELEMS) {
+            sorted = radix_sort_times(entries, entries + n, n);
         } else {
-            // n[one] should not appear here
-            err("sort_list: logic error / bad state");
-            exit(35);
+            qsort(entries, n, sizeof(time_entry), comp_time_entry);
         }
+    }
 
+    // entries are 16 bytes, so the order fits in the other half
+    size_t *order = (size_t *) ((sorted == entries) ? entries + n : entries);
+    for (size_t i = 0; i < n; ++i) {
+        order[i] = (uint32_t) sorted[i].nsec;
     }
-    qsort(list->arr, list->num_elems, sizeof(lstime_info), comp);
+    lstime_list_permute(list, order);
+    free(entries);
 }
 
+// the collation key for a path, in a per-thread buffer
+const char *lstime_path_sortkey(const char *path) {
+    static _Thread_local char buf[MAX_PATH_LEN];
+    size_t len = strxfrm(buf, path, sizeof(buf));
+    if (len >= sizeof(buf)) {
+        err("strxfrm exceeded buf len: %zu", sizeof(buf));
+        exit(39);
+    }
+    return buf;
+}
+
+static int collate_override = -1;
+
+// for tests: force byte order (1) or collation keys (0) in any locale,
+// or -1 to go by the locale again
+void lstime_collate_override(int bytes) {
+    collate_override = bytes;
+}
+
+// true when collation is plain byte order (C, POSIX, C.UTF-8)
+bool lstime_collate_is_bytes(void) {
+    if (collate_override >= 0) {
+        return collate_override != 0;
+    }
+    const char *name = setlocale(LC_COLLATE, NULL);
+    return name == NULL || strcmp(name, "C") == 0 ||
+        strcmp(name, "POSIX") == 0 || strncmp(name, "C.", 2) == 0;
+}
+
+// Compound --sort keys (like mtime,path) are encoded as one string per
+// item that strcmp orders like comparing field by field, so they take the
+// multikey quicksort below, and the --limit heap and the spill merge
+// compare them with a single strcmp.  Each field's direction (times newest
+// first, paths ascending, both flipped by --reverse) is folded into its
+// bytes.  A time is its normalized 96-bit key (as for time_entry) in 15
+// groups of 7 bits, each with the high bit set, so never nul.  A path is
+// its collation key with byte 1 escaped as 1 2 and ended by 1 1, so that
+// it sorts before any longer key; descending, the bytes are inverted with
+// 255 escaped as 255 1 and ended by 255 255.
+
+static char *put_groups(char *p, uint64_t v, int groups) {
+    for (int g = groups - 1; g >= 0; --g) {
+        *p++ = (char) (0x80 | ((v >> (7 * g)) & 0x7f));
+    }
+    return p;
+}
+
+static char *put_path_key(char *p, const char *path, bool rev, bool bytes) {
+    const char *key = bytes ? path : lstime_path_sortkey(path);
+    if (strlen(key) >= MAX_PATH_LEN) {
+        err("sort key exceeded buf len: %d", MAX_PATH_LEN);
+        exit(39);
+    }
+    unsigned esc = rev ? 255 : 1;
+    for (const unsigned char *c = (const unsigned char *) key; *c != '\0'; ++c) {
+        unsigned b = rev ? 256 - *c : *c;
+        *p++ = (char) b;
+        if (b == esc) {
+            *p++ = (char) (rev ? 1 : 2);
+        }
+    }
+    *p++ = (char) esc;
+    *p++ = (char) esc;
+    return p;
+}
+
+// the compound sort key for an item, in a per-thread buffer; bytes is
+// lstime_collate_is_bytes(), looked up once by the caller
+const char *lstime_compound_sortkey(const lstime_info *info,
+                                    const lstime_options *opts,
+                                    bool bytes) {
+    static _Thread_local char buf[2 * MAX_PATH_LEN + 16 * LSTIME_NUM_FIELDS];
+    const timespec *times[LSTIME_NUM_FIELDS] = {
+        &info->mtime, &info->atime, &info->ctime, &info->btime
+    };
+    uint64_t invert = opts->reverse ? 0 : UINT64_MAX;  // times newest first
+    char *p = buf;
+    for (const char *k = opts->sort_keys; *k != '\0'; ++k) {
+        int f = lstime_field_index(*k);
+        if (f < 0) {
+            p = put_path_key(p, info->path, opts->reverse, bytes);
+            continue;
+        }
+        uint64_t sec = ((uint64_t) times[f]->tv_sec ^ ((uint64_t) 1 << 63)) ^ invert;
+        uint64_t nsec = (uint32_t) (times[f]->tv_nsec + 1) ^ (uint32_t) invert;
+        p = put_groups(p, sec, 10);
+        p = put_groups(p, nsec, 5);
+    }
+    *p = '\0';
+    return buf;
+}
+
+// Multikey quicksort (Bentley & Sedgewick) for byte string keys: entries
+// are 3-way partitioned on the byte at depth, and the middle part moves on
+// to depth + 1, so shared directory prefixes are looked at only once per
+// partitioning level instead of once per strcmp.  For descending order
+// the bytes are inverted and the terminator sorts last.  Entries with
+// identical keys are put in index order, which keeps the sort stable.
+
+#define MKQS_SMALL 12
+
+static inline int key_byte(const path_entry *e, size_t depth, bool rev) {
+    int c = (unsigned char) e->key[depth];
+    return rev ? ((c == 0) ? 256 : 256 - c) : c;
+}
+
+static inline int comp_entry_from(const path_entry *e1, const path_entry *e2,
+                                  size_t depth, bool rev) {
+    int rc = strcmp(e1->key + depth, e2->key + depth);
+    if (rev) {
+        rc = -rc;
+    }
+    return (rc != 0) ? rc : (e1->idx > e2->idx) - (e1->idx < e2->idx);
+}
+
+static void insertion_sort_from(path_entry *a, size_t n, size_t depth, bool rev) {
+    for (size_t i = 1; i < n; ++i) {
+        path_entry tmp = a[i];
+        size_t j = i;
+        for ( ; j > 0 && comp_entry_from(&a[j - 1], &tmp, depth, rev) > 0; --j) {
+            a[j] = a[j - 1];
+        }
+        a[j] = tmp;
+    }
+}
+
+static int comp_entry_idx(const void *v1, const void *v2) {
+    const path_entry *e1 = v1;
+    const path_entry *e2 = v2;
+    return (e1->idx > e2->idx) - (e1->idx < e2->idx);
+}
+
+static inline void swap_entries(path_entry *a, size_t i, size_t j) {
+    path_entry t = a[i];
+    a[i] = a[j];
+    a[j] = t;
+}
+
+static void multikey_qsort(path_entry *a, size_t n, size_t depth, bool rev) {
+    while (n > MKQS_SMALL) {
+        // median of three bytes as the pivot
+        int c0 = key_byte(&a[0], depth, rev);
+        int c1 = key_byte(&a[n / 2], depth, rev);
+        int c2 = key_byte(&a[n - 1], depth, rev);
+        int pivot = (c0 < c1) ? ((c1 < c2) ? c1 : (c0 < c2) ? c2 : c0)
+                              : ((c0 < c2) ? c0 : (c1 < c2) ? c2 : c1);
+
+        // 3-way partition: [0, lt) less, [lt, gt) equal, [gt, n) greater
+        size_t lt = 0;
+        size_t i = 0;
+        size_t gt = n;
+        while (i < gt) {
+            int c = key_byte(&a[i], depth, rev);
+            if (c < pivot) {
+                swap_entries(a, lt++, i++);
+            } else if (c > pivot) {
+                swap_entries(a, i, --gt);
+            } else {
+                ++i;
+            }
+        }
+
+        multikey_qsort(a, lt, depth, rev);
+        multikey_qsort(a + gt, n - gt, depth, rev);
+        if (pivot == (rev ? 256 : 0)) {   // whole keys are equal
+            qsort(a + lt, gt - lt, sizeof(path_entry), comp_entry_idx);
+            return;
+        }
+        a += lt;
+        n = gt - lt;
+        ++depth;
+    }
+    insertion_sort_from(a, n, depth, rev);
+}
+
+static int comp_key_piece(const void *v1, const void *v2, void *ctx) {
+    return comp_entry_from(v1, v2, 0, *(const bool *) ctx);
+}
+
+static int comp_key_only(const void *v1, const void *v2, void *ctx) {
+    const path_entry *e1 = v1;
+    const path_entry *e2 = v2;
+    int rc = strcmp(e1->key, e2->key);
+    return *(const bool *) ctx ? -rc : rc;
+}
+
+static void sort_key_piece(void *base, size_t n, void *scratch, void *ctx) {
+    if (!natural_sort(base, n, sizeof(path_entry), scratch,
+                      comp_key_piece, comp_key_only, ctx)) {
+        multikey_qsort(base, n, 0, *(const bool *) ctx);
+    }
+}
+
+// byte order, or full keys already kept by --limit: no transform needed
+static void sort_paths_by_key(arr_wrapper *list, const lstime_options *opts,
+                              const char **keys, bool rev) {
+    size_t n = list->num_elems;
+    int threads = sort_threads(opts, n);
+    path_entry *entries = sort_alloc((threads > 1) ? 2 * n : n, sizeof(path_entry));
+    for (size_t i = 0; i < n; ++i) {
+        entries[i].key = keys[i];
+        entries[i].idx = i;
+    }
+
+    lstime_parallel_sort(entries, n, sizeof(path_entry),
+                         (threads > 1) ? entries + n : NULL, threads,
+                         sort_key_piece, comp_key_piece, &rev);
+
+    size_t *order = (size_t *) entries;  // reuse: idx never overtakes i
+    for (size_t i = 0; i < n; ++i) {
+        order[i] = entries[i].idx;
+    }
+    lstime_list_permute(list, order);
+    free(entries);
+}
+
+// transforming the paths is most of the work, so each thread does its own
+static int comp_prefix_piece(const void *v1, const void *v2, void *ctx) {
+    return *(const bool *) ctx ? comp_prefix_rev(v1, v2) : comp_prefix_fwd(v1, v2);
+}
+
+static int comp_prefix_only(const void *v1, const void *v2, void *ctx) {
+    return *(const bool *) ctx ? comp_prefix(v2, v1) : comp_prefix(v1, v2);
+}
+
+static void sort_prefix_piece(void *base, size_t n, void *scratch, void *ctx) {
+    prefix_entry *entries = base;
+    for (size_t i = 0; i < n; ++i) {
+        const char *key = lstime_path_sortkey(entries[i].path);
+        size_t len = strnlen(key, KEY_PREFIX_LEN);
+        memcpy(entries[i].prefix, key, len);
+        memset(entries[i].prefix + len, 0, KEY_PREFIX_LEN - len);
+    }
+    if (!natural_sort(entries, n, sizeof(prefix_entry), scratch,
+                      comp_prefix_piece, comp_prefix_only, ctx)) {
+        qsort(entries, n, sizeof(prefix_entry),
+              *(const bool *) ctx ? comp_prefix_rev : comp_prefix_fwd);
+    }
+}
+
+static void sort_paths_by_prefix(arr_wrapper *list, const lstime_options *opts) {
+    size_t n = list->num_elems;
+    int threads = sort_threads(opts, n);
+    prefix_entry *entries = sort_alloc((threads > 1) ? 2 * n : n, sizeof(prefix_entry));
+    for (size_t i = 0; i < n; ++i) {
+        entries[i].path = list->paths[i];
+        entries[i].idx = i;
+    }
+
+    bool rev = opts->reverse;
+    lstime_parallel_sort(entries, n, sizeof(prefix_entry),
+                         (threads > 1) ? entries + n : NULL, threads,
+                         sort_prefix_piece, comp_prefix_piece, &rev);
+
+    size_t *order = (size_t *) entries;  // reuse: idx never overtakes i
+    for (size_t i = 0; i < n; ++i) {
+        order[i] = entries[i].idx;
+    }
+    lstime_list_permute(list, order);
+    free(entries);
+}
+
+static void sort_paths(arr_wrapper *list, const lstime_options *opts) {
+    if (list->sortkeys != NULL) {
+        sort_paths_by_key(list, opts, list->sortkeys, opts->reverse);
+    } else if (lstime_collate_is_bytes()) {
+        sort_paths_by_key(list, opts, list->paths, opts->reverse);
+    } else {
+        sort_paths_by_prefix(list, opts);
+    }
+}
+
+// compound keys already carry their direction, so sort ascending
+static void sort_compound(arr_wrapper *list, const lstime_options *opts) {
+    if (list->sortkeys != NULL) {  // kept by --limit
+        sort_paths_by_key(list, opts, list->sortkeys, false);
+        return;
+    }
+    size_t n = list->num_elems;
+    const char **keys = sort_alloc(n, sizeof(char *));
+    lstime_arena strings;
+    memset(&strings, 0, sizeof(strings));
+    lstime_info info;
+    bool bytes = lstime_collate_is_bytes();
+    for (size_t i = 0; i < n; ++i) {
+        lstime_list_get(list, i, &info);
+        keys[i] = lstime_arena_strdup(&strings, lstime_compound_sortkey(&info, opts, bytes));
+    }
+    sort_paths_by_key(list, opts, keys, false);
+    lstime_arena_free(&strings);
+    free(keys);
+}
+
+void lstime_sort_list(arr_wrapper *list, const lstime_options *opts) {
+    lstime_list_end_limit(list);
+    if (list->num_elems == 0) {
+        return;
+    }
+    if (SORT_IS_COMPOUND(opts)) {
+        sort_compound(list, opts);
+    } else if (opts->sort_field == 'p') {
+        sort_paths(list, opts);
+    } else if (list->num_elems <= UINT32_MAX) {
+        sort_times(list, opts);
+    } else {
+        err("sort_list: too many items to sort: %zu", list->num_elems);
+        exit(35);
+    }
+}
@@ -0,0 +1,355 @@
+// SPDX-FileCopyrightText: © 2023 Daniel D. Mickey III
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "lstime_private.h"
+
+// External merge sort for --max-memory: when the buffered list would grow
+// past the budget, it is sorted and written out as a run to an unlinked
+// temp file (in $TMPDIR, or /tmp), then emptied.  At output time the runs
+// are merged with a heap of run readers.  Runs are kept in arrival order,
+// and equal keys go to the earlier run, so the output is the same as an
+// in-memory sort.  While spilling, runs are merged level by level, like
+// the digits of a counter: as soon as the newest MERGE_FANIN runs are all
+// of the same level, they are merged into one run of the next level.  So
+// every record is rewritten once per level, and the levels (and runs left
+// for the final merge) only grow with the log of the number of runs.
+//
+// A run record is, for each kept timestamp field, an int64_t sec and an
+// int32_t nsec, then a uint32_t length and the path bytes.  Path runs are
+// merged with strcoll (or strcmp for byte order collation), and compound
+// --sort keys are rebuilt from each record read and merged with strcmp.
+
+#define MAX_SPILL_RUNS 64
+#define MERGE_FANIN 8           // runs of one level merged into the next
+#define SPILL_SORT_BYTES 48     // per item scratch used while sorting
+#define SPILL_BUF_LEN (64 * 1024)
+
+typedef struct spill_run {
+    FILE *fp;
+    char *buf;                  // stdio buffer
+    lstime_info info;           // current record
+    char *path;
+    size_t path_cap;
+    char *key;                  // compound sort key of the current record
+    size_t key_cap;
+    int level;                  // 0 for a spilled list, +1 for every merge
+} spill_run;
+
+static spill_run *runs[MAX_SPILL_RUNS];
+static int num_runs = 0;
+static int (*path_cmp)(const char *, const char *) = strcmp;
+static bool collate_bytes = true;  // looked up once per merge
+
+static void spill_error(const char *what) {
+    err("%s: spill file: %s", what, strerror(errno));
+    exit(50);
+}
+
+static void *spill_alloc(size_t size) {
+    void *ptr = calloc(1, size);
+    if (ptr == NULL) {
+        err("spill out of memory: %s", strerror(errno));
+        exit(48);
+    }
+    return ptr;
+}
+
+static spill_run *run_create(void) {
+    const char *dir = getenv("TMPDIR");
+    if (dir == NULL || dir[0] == '\0') {
+        dir = "/tmp";
+    }
+    char name[MAX_PATH_LEN];
+    snprintf(name, sizeof(name), "%s/lstime.XXXXXX", dir);
+    int fd = mkstemp(name);
+    if (fd < 0) {
+        err("mkstemp: %s: %s", name, strerror(errno));
+        exit(50);
+    }
+    unlink(name);  // gone as soon as it is closed
+
+    spill_run *run = spill_alloc(sizeof(spill_run));
+    run->fp = fdopen(fd, "w+");
+    run->buf = spill_alloc(SPILL_BUF_LEN);
+    if (run->fp == NULL) {
+        spill_error("fdopen");
+    }
+    setvbuf(run->fp, run->buf, _IOFBF, SPILL_BUF_LEN);
+    return run;
+}
+
+static void run_free(spill_run *run) {
+    fclose(run->fp);
+    free(run->buf);
+    free(run->path);
+    free(run->key);
+    free(run);
+}
+
+static void write_string(FILE *fp, const char *str) {
+    uint32_t len = strlen(str);
+    if (fwrite(&len, sizeof(len), 1, fp) != 1 ||
+        fwrite(str, 1, len, fp) != len) {
+        spill_error("fwrite");
+    }
+}
+
+static void write_record(FILE *fp, unsigned fields, const lstime_info *info) {
+    const timespec *times[LSTIME_NUM_FIELDS] = {
+        &info->mtime, &info->atime, &info->ctime, &info->btime
+    };
+    for (int f = 0; f < LSTIME_NUM_FIELDS; ++f) {
+        if (fields & (1u << f)) {
+            int64_t sec = times[f]->tv_sec;
+            int32_t nsec = (int32_t) times[f]->tv_nsec;
+            if (fwrite(&sec, sizeof(sec), 1, fp) != 1 ||
+                fwrite(&nsec, sizeof(nsec), 1, fp) != 1) {
+                spill_error("fwrite");
+            }
+        }
+    }
+    write_string(fp, info->path);
+}
+
+static void read_string(FILE *fp, char **buf, size_t *cap) {
+    uint32_t len = 0;
+    if (fread(&len, sizeof(len), 1, fp) != 1) {
+        spill_error("fread");
+    }
+    if ((size_t) len + 1 > *cap) {
+        free(*buf);
+        *cap = MAX((size_t) len + 1, 256);
+        *buf = spill_alloc(*cap);
+    }
+    if (fread(*buf, 1, len, fp) != len) {
+        spill_error("fread");
+    }
+    (*buf)[len] = '\0';
+}
+
+// false at the end of the run
+static bool read_record(spill_run *run, unsigned fields) {
+    timespec *times[LSTIME_NUM_FIELDS] = {
+        &run->info.mtime, &run->info.atime, &run->info.ctime, &run->info.btime
+    };
+    for (int f = 0; f < LSTIME_NUM_FIELDS; ++f) {
+        if (!(fields & (1u << f))) {
+            SET_TIMESPEC_EMPTY(times[f]);
+            continue;
+        }
+        int64_t sec = 0;
+        int32_t nsec = 0;
+        if (fread(&sec, sizeof(sec), 1, run->fp) != 1) {
+            if (feof(run->fp)) {
+                return false;
+            }
+            spill_error("fread");
+        }
+        if (fread(&nsec, sizeof(nsec), 1, run->fp) != 1) {
+            spill_error("fread");
+        }
+        times[f]->tv_sec = sec;
+        times[f]->tv_nsec = nsec;
+    }
+    if ((fields & LSTIME_ALL_FIELDS) == 0) {  // the path length leads the record
+        int c = getc(run->fp);
+        if (c == EOF) {
+            if (ferror(run->fp)) {
+                spill_error("fread");
+            }
+            return false;
+        }
+        ungetc(c, run->fp);
+    }
+    read_string(run->fp, &run->path, &run->path_cap);
+    run->info.path = run->path;
+    run->info.sortkey = NULL;
+    return true;
+}
+
+// read the next record, and its compound sort key if needed
+static bool next_record(spill_run *run,
+                        const arr_wrapper *list,
+                        const lstime_options *opts) {
+    if (!read_record(run, list->fields)) {
+        return false;
+    }
+    if (SORT_IS_COMPOUND(opts)) {
+        const char *key = lstime_compound_sortkey(&run->info, opts, collate_bytes);
+        size_t len = strlen(key) + 1;
+        if (len > run->key_cap) {
+            free(run->key);
+            run->key_cap = MAX(len, 256);
+            run->key = spill_alloc(run->key_cap);
+        }
+        memcpy(run->key, key, len);
+    }
+    return true;
+}
+
+// true if a (from run ia) sorts after b (from run ib)
+static bool sorts_after(const lstime_options *opts,
+                        const spill_run *a, int ia,
+                        const spill_run *b, int ib) {
+    int rc = 0;
+    if (SORT_IS_COMPOUND(opts)) {
+        rc = strcmp(a->key, b->key);  // already in sort direction
+        return (rc != 0) ? (rc > 0) : (ia > ib);
+    }
+    if (opts->sort_field == 'p') {
+        rc = path_cmp(a->info.path, b->info.path);
+    } else {
+        const timespec *ta = NULL;
+        const timespec *tb = NULL;
+        switch (opts->sort_field) {
+            case 'm': ta = &a->info.mtime; tb = &b->info.mtime; break;
+            case 'a': ta = &a->info.atime; tb = &b->info.atime; break;
+            case 'c': ta = &a->info.ctime; tb = &b->info.ctime; break;
+            default:  ta = &a->info.btime; tb = &b->info.btime; break;
+        }
+        rc = (ta->tv_sec != tb->tv_sec) ? ((ta->tv_sec < tb->tv_sec) ? 1 : -1) :
+            (tb->tv_nsec > ta->tv_nsec) - (tb->tv_nsec < ta->tv_nsec);  // newest first
+    }
+    if (opts->reverse) {
+        rc = -rc;
+    }
+    return (rc != 0) ? (rc > 0) : (ia > ib);
+}
+
+static void heap_sift_down(const lstime_options *opts, int *heap, int n, int k) {
+    for (;;) {
+        int top = k;
+        int left = 2 * k + 1;
+        int right = left + 1;
+        if (left < n && sorts_after(opts, runs[heap[top]], heap[top],
+                                    runs[heap[left]], heap[left])) {
+            top = left;
+        }
+        if (right < n && sorts_after(opts, runs[heap[top]], heap[top],
+                                     runs[heap[right]], heap[right])) {
+            top = right;
+        }
+        if (top == k) {
+            return;
+        }
+        int t = heap[k];
+        heap[k] = heap[top];
+        heap[top] = t;
+        k = top;
+    }
+}
+
+// merge runs first to the last, either to out or (when out is NULL) into
+// a new run that takes their place
+static void merge_runs(lstime_writer *out,
+                       const arr_wrapper *list,
+                       const lstime_options *opts,
+                       int first) {
+    int heap[MAX_SPILL_RUNS];
+    collate_bytes = lstime_collate_is_bytes();
+    path_cmp = collate_bytes ? strcmp : strcoll;
+    int n = 0;
+    int level = 0;
+    for (int i = first; i < num_runs; ++i) {
+        level = MAX(level, runs[i]->level + 1);
+        if (fflush(runs[i]->fp) != 0 || fseek(runs[i]->fp, 0, SEEK_SET) != 0) {
+            spill_error("fseek");
+        }
+        if (next_record(runs[i], list, opts)) {
+            heap[n++] = i;
+        }
+    }
+    for (int k = n / 2 - 1; k >= 0; --k) {
+        heap_sift_down(opts, heap, n, k);
+    }
+
+    spill_run *merged = (out == NULL) ? run_create() : NULL;
+    while (n > 0) {
+        spill_run *run = runs[heap[0]];
+        if (merged != NULL) {
+            write_record(merged->fp, list->fields, &run->info);
+        } else {
+            lstime_output_item(out, &run->info, opts);
+        }
+        if (!next_record(run, list, opts)) {
+            heap[0] = heap[--n];
+        }
+        heap_sift_down(opts, heap, n, 0);
+    }
+
+    for (int i = first; i < num_runs; ++i) {
+        run_free(runs[i]);
+    }
+    num_runs = first;
+    if (merged != NULL) {
+        merged->level = level;
+        runs[num_runs++] = merged;
+    }
+}
+
+// sort the list, write it out as a run, and empty it
+static void spill_list(arr_wrapper *list, const lstime_options *opts) {
+    if (num_runs == MAX_SPILL_RUNS) {  // only after 8^9 runs
+        merge_runs(NULL, list, opts, 0);
+    }
+    lstime_sort_list(list, opts);
+    spill_run *run = run_create();
+    lstime_info info;
+    for (size_t i = 0; i < list->num_elems; ++i) {
+        lstime_list_get(list, i, &info);
+        write_record(run->fp, list->fields, &info);
+    }
+    runs[num_runs++] = run;
+
+    list->num_elems = 0;
+    lstime_arena_free(&list->strings);  // regrows from a small chunk
+    free(list->sortkeys);  // rebuilt by the next sort
+    list->sortkeys = NULL;
+}
+
+// spill first if adding one more item would take the list past the budget
+void lstime_spill_reserve(arr_wrapper *list, const lstime_options *opts) {
+    if (opts->max_memory == 0 || list->num_elems == 0) {
+        return;
+    }
+    unsigned fields = (list->fields == 0) ? LSTIME_ALL_FIELDS : list->fields;
+    size_t per_item = sizeof(char *) + SPILL_SORT_BYTES;
+    for (int f = 0; f < LSTIME_NUM_FIELDS; ++f) {
+        if (fields & (1u << f)) {
+            per_item += sizeof(int64_t) + sizeof(int32_t);
+        }
+    }
+    size_t strings = list->strings.total;
+    if (SORT_IS_COMPOUND(opts)) {  // a key per item is built for sorting
+        per_item += sizeof(char *) + 15 * LSTIME_NUM_FIELDS;
+        strings *= 2;
+    }
+    size_t cap = (list->num_elems < list->capacity) ?
+        list->capacity : list->capacity * 2;  // about to grow
+    if (cap * per_item + strings + MAX_PATH_LEN > opts->max_memory) {
+        spill_list(list, opts);
+        // levels only decrease from the oldest run, so the newest MERGE_FANIN
+        // runs are of one level if the first and last of them are
+        while (num_runs >= MERGE_FANIN &&
+               runs[num_runs - MERGE_FANIN]->level == runs[num_runs - 1]->level) {
+            merge_runs(NULL, list, opts, num_runs - MERGE_FANIN);
+        }
+    }
+}
+
+// false if nothing was spilled, so the list is sorted and output as usual
+bool lstime_spill_finish(lstime_writer *out,
+                         arr_wrapper *list,
+                         const lstime_options *opts) {
+    if (num_runs == 0) {
+        return false;
+    }
+    if (list->num_elems > 0) {
+        spill_list(list, opts);
+    }
+    merge_runs(out, list, opts, 0);
+    return true;
+}
@@ -4,6 +4,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 
 #include "lstime_private.h"
 
@@ -18,59 +19,75 @@ static timespec timespec_from_statx_timestamp(struct statx_timestamp tsx) {
   return ts;
 }
 
-int lstime_stat_path(lstime_info *info, int stat_flags) {
-    static int stat_dirfd = AT_FDCWD;
-    static unsigned int stat_mask =
-        STATX_ATIME | STATX_BTIME | STATX_CTIME | STATX_MTIME;
-    struct statx stxbuf;
-
-    int ret = statx(stat_dirfd, info->path, stat_flags, stat_mask, &stxbuf);
-    if (ret < 0) {
-        return ret;
-    }
+unsigned int lstime_statx_mask(void) {
+    return STATX_ATIME | STATX_BTIME | STATX_CTIME | STATX_MTIME;
+}
 
-    if (stxbuf.stx_mask & STATX_MTIME) {
-        info->mtime = timespec_from_statx_timestamp(stxbuf.stx_mtime);
+// also used for statx results reaped from io_uring
+void lstime_info_from_statx(lstime_info *info, const struct statx *stxbuf) {
+    if (stxbuf->stx_mask & STATX_MTIME) {
+        info->mtime = timespec_from_statx_timestamp(stxbuf->stx_mtime);
     } else {
         SET_TIMESPEC_EMPTY(&info->mtime);
     }
 
-    if (stxbuf.stx_mask & STATX_ATIME) {
-        info->atime = timespec_from_statx_timestamp(stxbuf.stx_atime);
+    if (stxbuf->stx_mask & STATX_ATIME) {
+        info->atime = timespec_from_statx_timestamp(stxbuf->stx_atime);
     } else {
         SET_TIMESPEC_EMPTY(&info->atime);
     }
 
-    if (stxbuf.stx_mask & STATX_CTIME) {
-        info->ctime = timespec_from_statx_timestamp(stxbuf.stx_ctime);
+    if (stxbuf->stx_mask & STATX_CTIME) {
+        info->ctime = timespec_from_statx_timestamp(stxbuf->stx_ctime);
     } else {
         SET_TIMESPEC_EMPTY(&info->ctime);
     }
 
-    if (stxbuf.stx_mask & STATX_BTIME) {
-        info->btime = timespec_from_statx_timestamp(stxbuf.stx_btime);
+    if (stxbuf->stx_mask & STATX_BTIME) {
+        info->btime = timespec_from_statx_timestamp(stxbuf->stx_btime);
     } else {
         SET_TIMESPEC_EMPTY(&info->btime);
     }
+}
 
+// name is resolved relative to dirfd, info->path is left untouched
+int lstime_stat_path_at(int dirfd,
+                        const char *name,
+                        lstime_info *info,
+                        int stat_flags) {
+    struct statx stxbuf;
+
+    int ret = statx(dirfd, name, stat_flags, lstime_statx_mask(), &stxbuf);
+    if (ret < 0) {
+        return ret;
+    }
+    lstime_info_from_statx(info, &stxbuf);
     return 0;
 }
 
 #else
 
-int lstime_stat_path(lstime_info *info int stat_flags) {
+unsigned int lstime_statx_mask(void) {
+    return 0;
+}
+
+void lstime_info_from_statx(lstime_info *info, const struct statx *stxbuf) {
+    (void) stxbuf;
+    SET_TIMESPEC_EMPTY(&info->mtime);
+    SET_TIMESPEC_EMPTY(&info->atime);
+    SET_TIMESPEC_EMPTY(&info->ctime);
+    SET_TIMESPEC_EMPTY(&info->btime);
+}
+
+int lstime_stat_path_at(int dirfd,
+                        const char *name,
+                        lstime_info *info,
+                        int stat_flags) {
     struct stat statbuf;
 
-    if (stat_flags & AT_SYMLINK_NOFOLLOW) {
-        int ret = lstat(info->path, &statbuf);
-        if (ret < 0) {
-            return ret;
-        }
-    } else {
-        int ret = lstat(info->path, &statbuf);
-        if (ret < 0) {
-            return ret;
-        }
+    int ret = fstatat(dirfd, name, &statbuf, stat_flags & AT_SYMLINK_NOFOLLOW);
+    if (ret < 0) {
+        return ret;
     }
 
     info->mtime = statbuf.st_mtim;
@@ -81,3 +98,153 @@ int lstime_stat_path(lstime_info *info int stat_flags) {
 }
 
 #endif
+
+// Per-thread LRU cache of open parent directory fds.  Input from find
+// lists many paths in the same few directories, so once a second path
+// has a cached parent, the parent is opened and its paths are stat'ed
+// by basename relative to it, which saves re-walking the full path in
+// the kernel.  A path whose parent was not seen before is stat'ed by
+// full path and only remembered, so one-off parents cost no extra open.
+//
+// A cached fd keeps pointing at the directory it opened, even after
+// that (or a directory above it) is renamed or replaced.  So before each
+// use its current location, from /proc/self/fd, is compared with the one
+// when opened, and the parent is reopened if it moved.  (A symlink in
+// the parent path that is retargeted is not noticed.)  That readlink is
+// cheaper than a second lookup of the parent path, but on local file
+// systems it can cost about as much as the path walk it saves.
+
+#define DIR_CACHE_SLOTS 8
+
+typedef struct dir_entry {
+    char *dir;          // parent directory as in the paths, NULL if unused
+    size_t len;
+    size_t cap;
+    char *real;         // where the fd's directory was when opened
+    size_t real_len;
+    int fd;             // -1 until opened, -2 if the open failed
+    unsigned long used; // LRU clock
+} dir_entry;
+
+static _Thread_local dir_entry dir_cache[DIR_CACHE_SLOTS];
+static _Thread_local unsigned long dir_clock = 0;
+
+static void dir_entry_close(dir_entry *e) {
+    if (e->dir != NULL && e->fd >= 0) {  // an unused (zeroed) entry has fd 0
+        close(e->fd);
+    }
+    e->fd = -1;
+    free(e->real);
+    e->real = NULL;
+}
+
+static _Thread_local int proc_fd_dir = -1;  // /proc/self/fd
+
+// the current location of the directory open as fd; 0 if unknown
+static size_t fd_location(int fd, char *buf, size_t cap) {
+    if (proc_fd_dir < 0) {
+        proc_fd_dir = open("/proc/self/fd", O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (proc_fd_dir < 0) {
+            return 0;
+        }
+    }
+    char name[16];
+    snprintf(name, sizeof(name), "%d", fd);
+    ssize_t n = readlinkat(proc_fd_dir, name, buf, cap);
+    return (n > 0 && (size_t) n < cap) ? (size_t) n : 0;
+}
+
+static void dir_entry_open(dir_entry *e) {
+    char buf[MAX_PATH_LEN];
+    e->fd = open(e->dir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (e->fd < 0) {
+        e->fd = -2;  // let the full path lookups report errors
+        return;
+    }
+    size_t n = fd_location(e->fd, buf, sizeof(buf));
+    e->real = (n > 0) ? malloc(n) : NULL;
+    if (e->real == NULL) {
+        close(e->fd);
+        e->fd = -2;  // cannot be checked, so not used
+        return;
+    }
+    memcpy(e->real, buf, n);
+    e->real_len = n;
+}
+
+// is the open directory still where it was when opened?
+static bool dir_entry_current(const dir_entry *e) {
+    char buf[MAX_PATH_LEN];
+    size_t n = fd_location(e->fd, buf, sizeof(buf));
+    return n == e->real_len && memcmp(buf, e->real, n) == 0;
+}
+
+// remember dir[0..len) in the least recently used slot
+static void dir_cache_insert(const char *dir, size_t len) {
+    dir_entry *e = &dir_cache[0];
+    for (int i = 1; i < DIR_CACHE_SLOTS && e->dir != NULL; ++i) {
+        if (dir_cache[i].dir == NULL || dir_cache[i].used < e->used) {
+            e = &dir_cache[i];
+        }
+    }
+    dir_entry_close(e);
+    if (len + 1 > e->cap) {
+        char *buf = realloc(e->dir, MAX(len + 1, 2 * e->cap));
+        if (buf == NULL) {
+            return;  // just not cached
+        }
+        e->dir = buf;
+        e->cap = MAX(len + 1, 2 * e->cap);
+    }
+    memcpy(e->dir, dir, len);
+    e->dir[len] = '\0';
+    e->len = len;
+    e->used = ++dir_clock;
+}
+
+static dir_entry *dir_cache_find(const char *dir, size_t len) {
+    for (int i = 0; i < DIR_CACHE_SLOTS; ++i) {
+        dir_entry *e = &dir_cache[i];
+        if (e->dir != NULL && e->len == len && memcmp(e->dir, dir, len) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// close the calling thread's cached directory fds
+void lstime_stat_path_finit(void) {
+    for (int i = 0; i < DIR_CACHE_SLOTS; ++i) {
+        dir_entry_close(&dir_cache[i]);
+        free(dir_cache[i].dir);
+        memset(&dir_cache[i], 0, sizeof(dir_cache[i]));
+    }
+    if (proc_fd_dir >= 0) {
+        close(proc_fd_dir);
+        proc_fd_dir = -1;
+    }
+}
+
+int lstime_stat_path(lstime_info *info, int stat_flags) {
+    const char *path = info->path;
+    const char *slash = strrchr(path, '/');
+    if (slash != NULL && slash[1] != '\0') {
+        size_t len = (slash == path) ? 1 : (size_t)(slash - path);  // "/x"
+        dir_entry *e = dir_cache_find(path, len);
+        if (e == NULL) {
+            dir_cache_insert(path, len);
+        } else {
+            e->used = ++dir_clock;
+            if (e->fd >= 0 && !dir_entry_current(e)) {
+                dir_entry_close(e);  // moved, so reopen by path
+            }
+            if (e->fd == -1) {
+                dir_entry_open(e);
+            }
+            if (e->fd >= 0) {
+                return lstime_stat_path_at(e->fd, slash + 1, info, stat_flags);
+            }
+        }
+    }
+    return lstime_stat_path_at(AT_FDCWD, path, info, stat_flags);
+}
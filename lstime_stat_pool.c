@@ -0,0 +1,306 @@
+// SPDX-FileCopyrightText: © 2023 Daniel D. Mickey III
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "lstime_private.h"
+
+// Asynchronous stat for --jobs and --io-engine: paths are queued into a
+// ring of slots (the reorder window), stat'ed either by worker threads or
+// by batched io_uring statx requests, and the main thread emits completed
+// slots strictly in submission order.
+
+#define SLOT_FREE    0
+#define SLOT_PENDING 1
+#define SLOT_DONE    2
+
+#define SLOTS_PER_JOB 64
+
+typedef struct stat_slot {
+    lstime_info info;   // path points into path_buf
+    char *path_buf;     // reused for every path queued in this slot
+    size_t path_cap;
+    int err;            // errno from lstime_stat_path, 0 on success
+    int state;
+#if defined(AT_STATX_SYNC_TYPE) && ! defined(USE_STAT_AND_LSTAT)
+    struct statx stxbuf;  // io_uring completion target
+#endif
+} stat_slot;
+
+typedef struct stat_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work_cv;   // signaled when a slot becomes pending
+    pthread_cond_t done_cv;   // signaled when a slot becomes done
+    stat_slot *slots;
+    size_t window;            // number of slots
+    size_t head;              // next slot to emit
+    size_t next;              // next slot for a worker to claim
+    size_t tail;              // next slot to fill
+    bool closing;
+    int mode;
+    pthread_t *threads;
+    int num_threads;
+    lstime_uring *ring;
+    unsigned batch;           // sqes queued before entering the kernel
+    lstime_writer *out;
+    arr_wrapper *list;
+    const lstime_options *opts;
+} stat_pool;
+
+static stat_pool *pool = NULL;
+
+static void *stat_worker(void *arg) {
+    stat_pool *p = arg;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (p->next == p->tail && !p->closing) {
+            pthread_cond_wait(&p->work_cv, &p->lock);
+        }
+        if (p->next == p->tail) {   // closing and nothing left to claim
+            break;
+        }
+        stat_slot *slot = &p->slots[p->next % p->window];
+        ++p->next;
+        pthread_mutex_unlock(&p->lock);
+
+        int err = 0;
+        if (lstime_stat_path(&slot->info, p->opts->stat_flags) != 0) {
+            err = errno;
+        }
+
+        pthread_mutex_lock(&p->lock);
+        slot->err = err;
+        slot->state = SLOT_DONE;
+        pthread_cond_signal(&p->done_cv);
+    }
+    pthread_mutex_unlock(&p->lock);
+    lstime_stat_path_finit();
+    return NULL;
+}
+
+static void pool_start_threads(stat_pool *p, int jobs) {
+    p->threads = calloc(jobs, sizeof(pthread_t));
+    if (p->threads == NULL) {
+        err("stat pool out of memory: %s", strerror(errno));
+        exit(40);
+    }
+    for (int i = 0; i < jobs; ++i) {
+        int rc = pthread_create(&p->threads[i], NULL, stat_worker, p);
+        if (rc != 0) {
+            err("pthread_create: %s", strerror(rc));
+            exit(41);
+        }
+        ++p->num_threads;
+    }
+}
+
+// --io-engine uring falls back to the thread pool, or with a single job
+// to synchronous statx, when io_uring or its statx op is unavailable
+int lstime_stat_pool_mode(const lstime_options *opts, bool have_ring) {
+    if (opts->io_engine == 'u' && have_ring) {
+        return POOL_URING;
+    }
+    if (opts->io_engine == 'u' && opts->jobs <= 1) {
+        return POOL_SYNC;
+    }
+    return POOL_THREADS;
+}
+
+static void pool_create(lstime_writer *out,
+                        arr_wrapper *list,
+                        const lstime_options *opts) {
+    pool = calloc(1, sizeof(stat_pool));
+    if (pool == NULL) {
+        err("stat pool out of memory: %s", strerror(errno));
+        exit(40);
+    }
+    pool->out = out;
+    pool->list = list;
+    pool->opts = opts;
+    pool->window = (size_t) opts->jobs * SLOTS_PER_JOB;
+
+    if (opts->io_engine == 'u') {
+        pool->ring = lstime_uring_open(opts->queue_depth);
+        if (pool->ring == NULL && opts->debug) {
+            warn("io_uring unavailable, using synchronous statx: %s",
+                 strerror(errno));
+        }
+    }
+    pool->mode = lstime_stat_pool_mode(opts, pool->ring != NULL);
+    if (pool->mode == POOL_URING) {
+        pool->window = MIN((size_t) opts->queue_depth,
+                           lstime_uring_capacity(pool->ring));
+        pool->batch = MAX(1, pool->window / 8);
+    }
+
+    pool->slots = calloc(pool->window, sizeof(stat_slot));
+    if (pool->slots == NULL) {
+        err("stat pool out of memory: %s", strerror(errno));
+        exit(40);
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cv, NULL);
+    pthread_cond_init(&pool->done_cv, NULL);
+
+    if (pool->mode == POOL_THREADS) {
+        pool_start_threads(pool, opts->jobs);
+    }
+}
+
+// hand queued statx requests to the kernel and collect what has finished
+static void pool_uring_poll(stat_pool *p, unsigned wait_nr) {
+    if (lstime_uring_submit(p->ring, wait_nr) != 0) {
+        err("io_uring_enter: %s", strerror(errno));
+        exit(42);
+    }
+    uint64_t seq = 0;
+    int res = 0;
+    while (lstime_uring_reap(p->ring, &seq, &res)) {
+        stat_slot *slot = &p->slots[seq % p->window];
+        if (res < 0) {
+            slot->err = -res;
+        } else {
+#if defined(AT_STATX_SYNC_TYPE) && ! defined(USE_STAT_AND_LSTAT)
+            lstime_info_from_statx(&slot->info, &slot->stxbuf);
+#endif
+            slot->err = 0;
+        }
+        slot->state = SLOT_DONE;
+    }
+}
+
+// emit the oldest slot, waiting for its stat to finish if needed
+static void pool_emit_head(stat_pool *p, bool wait) {
+    stat_slot *slot = &p->slots[p->head % p->window];
+    bool done = false;
+
+    if (p->mode == POOL_URING) {
+        while (wait && slot->state != SLOT_DONE) {
+            pool_uring_poll(p, 1);
+        }
+        done = (slot->state == SLOT_DONE);
+    } else {
+        pthread_mutex_lock(&p->lock);
+        while (wait && slot->state != SLOT_DONE) {
+            pthread_cond_wait(&p->done_cv, &p->lock);
+        }
+        done = (slot->state == SLOT_DONE);
+        pthread_mutex_unlock(&p->lock);
+    }
+    if (!done) {
+        return;
+    }
+
+    if (slot->err != 0) {
+        err("lstime_stat_path: %s: %s", slot->info.path, strerror(slot->err));
+        exit(3);
+    }
+    lstime_emit_info(p->out, p->list, p->opts, &slot->info);
+    slot->state = SLOT_FREE;
+    ++p->head;  // only the main thread touches head
+}
+
+static void pool_queue_slot(stat_pool *p, stat_slot *slot) {
+    if (p->mode == POOL_SYNC) {
+        if (lstime_stat_path(&slot->info, p->opts->stat_flags) != 0) {
+            slot->err = errno;
+        }
+        slot->state = SLOT_DONE;
+        ++p->tail;
+    } else if (p->mode == POOL_URING) {
+#if defined(AT_STATX_SYNC_TYPE) && ! defined(USE_STAT_AND_LSTAT)
+        // full paths here: a cached parent dir fd could be evicted and
+        // closed while the request is still in flight
+        while (!lstime_uring_statx(p->ring, AT_FDCWD, slot->info.path,
+                                   p->opts->stat_flags, lstime_statx_mask(),
+                                   &slot->stxbuf, p->tail)) {
+            pool_uring_poll(p, 0);  // submission queue full
+        }
+#endif
+        slot->state = SLOT_PENDING;
+        ++p->tail;
+        if (p->tail - p->next >= p->batch) {
+            p->next = p->tail;  // next marks the last submitted slot
+            pool_uring_poll(p, 0);
+        }
+    } else {
+        pthread_mutex_lock(&p->lock);
+        slot->state = SLOT_PENDING;
+        ++p->tail;
+        pthread_cond_signal(&p->work_cv);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+void lstime_stat_pool_submit(lstime_writer *out,
+                             arr_wrapper *list,
+                             const lstime_options *opts,
+                             const char *path) {
+    if (pool == NULL) {
+        pool_create(out, list, opts);
+    }
+
+    // flush whatever is already finished, then make room if still full
+    while (pool->head < pool->tail) {
+        size_t head = pool->head;
+        pool_emit_head(pool, false);
+        if (pool->head == head) {
+            break;
+        }
+    }
+    if (lstime_limit_reached(list, opts, pool->tail - pool->head)) {
+        return;  // the paths in flight make up the rest of --limit
+    }
+    while (pool->tail - pool->head >= pool->window) {
+        pool_emit_head(pool, true);
+    }
+
+    stat_slot *slot = &pool->slots[pool->tail % pool->window];
+    size_t len = strlen(path) + 1;
+    if (len > slot->path_cap) {
+        free(slot->path_buf);
+        slot->path_cap = MAX(len, 256);
+        slot->path_buf = malloc(slot->path_cap);
+        if (slot->path_buf == NULL) {
+            err("stat pool out of memory: %s", strerror(errno));
+            exit(40);
+        }
+    }
+    slot->info.path = memcpy(slot->path_buf, path, len);
+    slot->info.sortkey = NULL;
+    slot->err = 0;
+    pool_queue_slot(pool, slot);
+}
+
+void lstime_stat_pool_finish(void) {
+    if (pool == NULL) {
+        return;
+    }
+    while (pool->head < pool->tail) {
+        pool_emit_head(pool, true);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->closing = true;
+    pthread_cond_broadcast(&pool->work_cv);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->num_threads; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    lstime_uring_close(pool->ring);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cv);
+    pthread_cond_destroy(&pool->done_cv);
+    free(pool->threads);
+    for (size_t i = 0; i < pool->window; ++i) {
+        free(pool->slots[i].path_buf);
+    }
+    free(pool->slots);
+    free(pool);
+    pool = NULL;
+}
@@ -21,6 +21,7 @@ int main() {
     format_path_suite();
     format_timestamp_suite();
     output_item_suite();
+    of_path_suite();
     int rc = du_total_summary(NULL);
     exit(rc);
 }
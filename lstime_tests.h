@@ -9,5 +9,6 @@
 int format_path_suite(void);
 int format_timestamp_suite(void);
 int output_item_suite(void);
+int of_path_suite(void);
 
 #endif
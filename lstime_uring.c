@@ -0,0 +1,269 @@
+// SPDX-FileCopyrightText: © 2023 Daniel D. Mickey III
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "lstime_private.h"
+
+// #define USE_NO_URING 1  // uncomment if io_uring(7) headers not available
+
+static bool uring_disabled = false;
+
+void lstime_uring_disable(bool disable) {
+    uring_disabled = disable;
+}
+
+#if defined(__linux__) && ! defined(USE_NO_URING) && ! defined(USE_STAT_AND_LSTAT)
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+// Minimal raw io_uring(7) ring, just enough for batched IORING_OP_STATX.
+// No liburing dependency; the ring memory is mapped directly.
+
+struct lstime_uring {
+    int fd;
+    unsigned sq_entries;
+    unsigned cq_entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map;
+    size_t sq_map_len;
+    void *cq_map;
+    size_t cq_map_len;
+    size_t sqes_len;
+    unsigned to_submit;    // queued sqes not yet handed to the kernel
+};
+
+static int uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                       unsigned flags) {
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                         flags, NULL, 0);
+}
+
+static bool uring_supports_statx(int fd) {
+    size_t len = sizeof(struct io_uring_probe) +
+        256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, len);
+    if (probe == NULL) {
+        return false;
+    }
+    bool ok = false;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE,
+                probe, 256) == 0) {
+        ok = probe->last_op >= IORING_OP_STATX &&
+            (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+void lstime_uring_close(lstime_uring *ring) {
+    if (ring == NULL) {
+        return;
+    }
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqes_len);
+    }
+    if (ring->cq_map != NULL && ring->cq_map != ring->sq_map) {
+        munmap(ring->cq_map, ring->cq_map_len);
+    }
+    if (ring->sq_map != NULL) {
+        munmap(ring->sq_map, ring->sq_map_len);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    free(ring);
+}
+
+// returns NULL (with errno set) when io_uring or its statx op is unavailable
+lstime_uring *lstime_uring_open(unsigned entries) {
+    if (uring_disabled) {
+        errno = EOPNOTSUPP;
+        return NULL;
+    }
+    lstime_uring *ring = calloc(1, sizeof(lstime_uring));
+    if (ring == NULL) {
+        return NULL;
+    }
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ring->fd = uring_setup(entries, &p);
+    if (ring->fd < 0) {
+        free(ring);
+        return NULL;
+    }
+    if (!uring_supports_statx(ring->fd)) {
+        lstime_uring_close(ring);
+        errno = EOPNOTSUPP;
+        return NULL;
+    }
+
+    ring->sq_entries = p.sq_entries;
+    ring->cq_entries = p.cq_entries;
+    ring->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->sq_map_len = MAX(ring->sq_map_len, ring->cq_map_len);
+        ring->cq_map_len = ring->sq_map_len;
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) {
+        ring->sq_map = NULL;
+        lstime_uring_close(ring);
+        return NULL;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_map = ring->sq_map;
+    } else {
+        ring->cq_map = mmap(NULL, ring->cq_map_len, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED) {
+            ring->cq_map = NULL;
+            lstime_uring_close(ring);
+            return NULL;
+        }
+    }
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        lstime_uring_close(ring);
+        return NULL;
+    }
+
+    char *sq = ring->sq_map;
+    char *cq = ring->cq_map;
+    ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return ring;
+}
+
+unsigned lstime_uring_capacity(const lstime_uring *ring) {
+    return ring->sq_entries;
+}
+
+// queue one statx; returns false when the submission queue is full
+bool lstime_uring_statx(lstime_uring *ring,
+                        int dirfd,
+                        const char *path,
+                        int flags,
+                        unsigned int mask,
+                        struct statx *buf,
+                        uint64_t user_data) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sq_tail;
+    if (tail - head >= ring->sq_entries) {
+        return false;
+    }
+    unsigned idx = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = dirfd;
+    sqe->addr = (uint64_t)(uintptr_t) path;
+    sqe->len = mask;
+    sqe->off = (uint64_t)(uintptr_t) buf;
+    sqe->statx_flags = flags;
+    sqe->user_data = user_data;
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++ring->to_submit;
+    return true;
+}
+
+// hand queued sqes to the kernel, optionally waiting for completions
+int lstime_uring_submit(lstime_uring *ring, unsigned wait_nr) {
+    unsigned flags = (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0;
+    for (;;) {
+        int rc = uring_enter(ring->fd, ring->to_submit, wait_nr, flags);
+        if (rc >= 0) {
+            ring->to_submit -= MIN((unsigned) rc, ring->to_submit);
+            return 0;
+        }
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+// pop one completion; res is the statx result (0 or -errno)
+bool lstime_uring_reap(lstime_uring *ring, uint64_t *user_data, int *res) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return false;
+    }
+    struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+    *user_data = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#else
+
+lstime_uring *lstime_uring_open(unsigned entries) {
+    (void) entries;
+    errno = ENOSYS;
+    return NULL;
+}
+
+void lstime_uring_close(lstime_uring *ring) {
+    (void) ring;
+}
+
+unsigned lstime_uring_capacity(const lstime_uring *ring) {
+    (void) ring;
+    return 0;
+}
+
+bool lstime_uring_statx(lstime_uring *ring,
+                        int dirfd,
+                        const char *path,
+                        int flags,
+                        unsigned int mask,
+                        struct statx *buf,
+                        uint64_t user_data) {
+    (void) ring; (void) dirfd; (void) path; (void) flags;
+    (void) mask; (void) buf; (void) user_data;
+    return false;
+}
+
+int lstime_uring_submit(lstime_uring *ring, unsigned wait_nr) {
+    (void) ring; (void) wait_nr;
+    errno = ENOSYS;
+    return -1;
+}
+
+bool lstime_uring_reap(lstime_uring *ring, uint64_t *user_data, int *res) {
+    (void) ring; (void) user_data; (void) res;
+    return false;
+}
+
+#endif
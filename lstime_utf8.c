@@ -0,0 +1,97 @@
+// SPDX-FileCopyrightText: © 2023 Daniel D. Mickey III
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "lstime_private.h"
+
+// UTF-8 validation and decoding for path quoting (this used to be a
+// conversion to UTF-32 through iconv).  Only what RFC 3629 allows is
+// valid: no overlong forms, no surrogates (U+D800 to U+DFFF), nothing past
+// U+10FFFF, and no stray or missing continuation bytes.  Runs of ASCII
+// are skipped 16 bytes at a time (SSE2) or 8 at a time, and no state is
+// kept, so any number of threads can use it.
+
+static const uint32_t min_cp[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+
+// length of the valid sequence at str (with cp set), or 0 if invalid
+int lstime_utf8_decode(const char *str, size_t len, uint32_t *cp) {
+    const unsigned char *s = (const unsigned char *) str;
+    unsigned c = s[0];
+    if (c < 0x80) {
+        *cp = c;
+        return 1;
+    }
+    int n = 0;
+    uint32_t v = 0;
+    if (c >= 0xC2 && c <= 0xDF) {
+        n = 2;
+        v = c & 0x1F;
+    } else if ((c & 0xF0) == 0xE0) {
+        n = 3;
+        v = c & 0x0F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 4;
+        v = c & 0x07;
+    } else {
+        return 0;  // continuation byte, C0, C1 or F5 to FF
+    }
+    if (len < (size_t) n) {
+        return 0;
+    }
+    for (int k = 1; k < n; ++k) {
+        if ((s[k] & 0xC0) != 0x80) {
+            return 0;
+        }
+        v = (v << 6) | (s[k] & 0x3F);
+    }
+    if (v < min_cp[n] || v > 0x10FFFF || (v >= 0xD800 && v <= 0xDFFF)) {
+        return 0;
+    }
+    *cp = v;
+    return n;
+}
+
+// bytes before the first non-ASCII one
+static size_t ascii_span(const char *str, size_t len) {
+    size_t i = 0;
+#ifdef __SSE2__
+    for ( ; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (str + i));
+        unsigned mask = (unsigned) _mm_movemask_epi8(v);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for ( ; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, str + i, sizeof(word));
+        if ((word & 0x8080808080808080u) != 0) {
+            break;
+        }
+    }
+    while (i < len && (unsigned char) str[i] < 0x80) {
+        ++i;
+    }
+    return i;
+}
+
+// length of the valid UTF-8 prefix of str, len if all of it is valid
+size_t lstime_utf8_valid_len(const char *str, size_t len) {
+    size_t i = 0;
+    for (;;) {
+        i += ascii_span(str + i, len - i);
+        if (i == len) {
+            return len;
+        }
+        uint32_t cp;
+        int n = lstime_utf8_decode(str + i, len - i, &cp);
+        if (n == 0) {
+            return i;
+        }
+        i += n;
+    }
+}
@@ -0,0 +1,532 @@
+// SPDX-FileCopyrightText: © 2023 Daniel D. Mickey III
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "lstime_private.h"
+
+// Recursive directory walk for --recursive.  Entries are read with
+// getdents64(2) and stat'ed relative to the open directory fd, so each
+// statx resolves a single path component.  A directory's entries are
+// listed before descending into its subdirectories.  Symlinks to
+// directories are not followed below the starting path.
+//
+// With --jobs, subdirectories are distributed over worker threads.
+// Each worker owns a deque of pending directories: it pushes and pops
+// at the bottom, and idle workers steal from the top of other deques.
+// Stat'ed entries are handed to the emit/list consumers in per-directory
+// batches through a shared sink lock, so output order is unspecified.
+//
+// With --sort none and --limit, the walk stops as soon as enough items
+// have been output: no more entries are stat'ed and no more directories
+// read (the parallel walkers drop what is still queued).
+
+#define WALK_DENTS_LEN (64 * 1024)
+#define WALK_MAX_OPEN_FDS 128  // deeper levels reopen by full path
+#define WALK_MAX_QUEUED_FDS 512  // queued directories kept open
+#define WALK_BATCH_LEN 256
+
+#define DIR_OPEN_FLAGS (O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+
+typedef struct walk_state {
+    lstime_writer *out;
+    arr_wrapper *list;
+    const lstime_options *opts;
+    char *path;         // path of the current entry
+    size_t path_cap;
+    char *dents;        // getdents64 buffer, reused at every level
+} walk_state;
+
+// extend ws->path (currently len bytes) with "/name", return new length
+static size_t path_append(walk_state *ws, size_t len, const char *name) {
+    size_t name_len = strlen(name);
+    size_t need = len + 1 + name_len + 1;
+    if (need > ws->path_cap) {
+        size_t new_cap = MAX(need, ws->path_cap * 2);
+        ws->path = realloc(ws->path, new_cap);
+        if (ws->path == NULL) {
+            err("walk path out of memory: %s", strerror(errno));
+            exit(43);
+        }
+        ws->path_cap = new_cap;
+    }
+    if (len > 0 && ws->path[len - 1] != '/') {
+        ws->path[len++] = '/';
+    }
+    memcpy(ws->path + len, name, name_len + 1);
+    return len + name_len;
+}
+
+static bool is_dot_or_dotdot(const char *name) {
+    return name[0] == '.' &&
+        (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+static bool entry_is_dir(int dirfd, const struct dirent64 *d) {
+    if (d->d_type != DT_UNKNOWN) {
+        return d->d_type == DT_DIR;
+    }
+    // some file systems do not fill in d_type
+    struct stat st;
+    return fstatat(dirfd, d->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+        S_ISDIR(st.st_mode);
+}
+
+// add a nul-terminated name to a packed list of subdirectory names
+static void push_name(char **names, size_t *len, size_t *cap, const char *name) {
+    size_t n = strlen(name) + 1;
+    if (*len + n > *cap) {
+        *cap = MAX(*len + n, MAX(*cap * 2, 1024));
+        *names = realloc(*names, *cap);
+        if (*names == NULL) {
+            err("walk names out of memory: %s", strerror(errno));
+            exit(43);
+        }
+    }
+    memcpy(*names + *len, name, n);
+    *len += n;
+}
+
+static void walk_dir(walk_state *ws, int dirfd, size_t path_len, int depth) {
+    char *subdirs = NULL;
+    size_t subdirs_len = 0;
+    size_t subdirs_cap = 0;
+    bool done = false;   // --limit reached
+
+    while (!done) {
+        ssize_t n = getdents64(dirfd, ws->dents, WALK_DENTS_LEN);
+        if (n < 0) {
+            ws->path[path_len] = '\0';
+            warn("getdents64: %s: %s", ws->path, strerror(errno));
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        for (ssize_t off = 0; off < n; ) {
+            struct dirent64 *d = (struct dirent64 *)(ws->dents + off);
+            off += d->d_reclen;
+            if (is_dot_or_dotdot(d->d_name)) {
+                continue;
+            }
+            path_append(ws, path_len, d->d_name);
+
+            lstime_info info;
+            info.sortkey = NULL;
+            if (lstime_stat_path_at(dirfd, d->d_name, &info,
+                                    ws->opts->stat_flags) != 0) {
+                // entries can vanish while walking, so not fatal
+                warn("lstime_stat_path: %s: %s", ws->path, strerror(errno));
+                continue;
+            }
+            info.path = ws->path;
+            lstime_emit_info(ws->out, ws->list, ws->opts, &info);
+            if (lstime_limit_reached(ws->list, ws->opts, 0)) {
+                done = true;
+                break;
+            }
+
+            if (entry_is_dir(dirfd, d)) {
+                push_name(&subdirs, &subdirs_len, &subdirs_cap, d->d_name);
+            }
+        }
+    }
+
+    if (depth >= WALK_MAX_OPEN_FDS) {
+        close(dirfd);
+        dirfd = -1;
+    }
+    for (size_t off = 0; off < subdirs_len; ) {
+        if (lstime_limit_reached(ws->list, ws->opts, 0)) {
+            break;
+        }
+        const char *name = subdirs + off;
+        off += strlen(name) + 1;
+        size_t len = path_append(ws, path_len, name);
+        int fd = (dirfd >= 0) ?
+            openat(dirfd, name, DIR_OPEN_FLAGS | O_NOFOLLOW) :
+            open(ws->path, DIR_OPEN_FLAGS | O_NOFOLLOW);
+        if (fd < 0) {
+            warn("open: %s: %s", ws->path, strerror(errno));
+            continue;
+        }
+        walk_dir(ws, fd, len, depth + 1);
+    }
+    if (dirfd >= 0) {
+        close(dirfd);
+    }
+    free(subdirs);
+}
+
+typedef struct walk_item {
+    char *path;
+    int fd;             // already open directory, or -1 to open by path
+} walk_item;
+
+typedef struct walk_deque {
+    pthread_mutex_t lock;
+    walk_item *items;
+    size_t cap;
+    size_t top;         // steal end
+    size_t bottom;      // owner end
+} walk_deque;
+
+typedef struct walk_team {
+    pthread_mutex_t lock;     // guards pending and generation, taken
+                              // before a deque lock
+    pthread_cond_t cv;        // signaled on new work or completion
+    size_t pending;           // directories queued or being read
+    unsigned long generation; // bumped on every push
+    int queued_fds;
+    bool stop;                // --limit reached, set under sink_lock
+    pthread_mutex_t sink_lock;
+    walk_deque *deques;
+    int num_workers;
+} walk_team;
+
+typedef struct walk_worker {
+    walk_team *team;
+    int id;
+    walk_state ws;
+    lstime_info *batch;
+    size_t batch_len;
+    size_t batch_max;          // smaller with --sort none --limit
+    lstime_arena batch_paths;  // paths of the batched items
+    lstime_format_ctx fmt;     // formatting state, freed after the join
+} walk_worker;
+
+static void deque_push(walk_deque *dq, walk_item item) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom - dq->top == dq->cap) {
+        size_t new_cap = MAX(dq->cap * 2, 64);
+        walk_item *items = malloc(new_cap * sizeof(walk_item));
+        if (items == NULL) {
+            err("walk deque out of memory: %s", strerror(errno));
+            exit(43);
+        }
+        for (size_t i = dq->top; i < dq->bottom; ++i) {
+            items[i - dq->top] = dq->items[i % dq->cap];
+        }
+        free(dq->items);
+        dq->items = items;
+        dq->bottom -= dq->top;
+        dq->top = 0;
+        dq->cap = new_cap;
+    }
+    dq->items[dq->bottom++ % dq->cap] = item;
+    pthread_mutex_unlock(&dq->lock);
+}
+
+static bool deque_pop(walk_deque *dq, walk_item *item) {
+    bool found = false;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom > dq->top) {
+        *item = dq->items[--dq->bottom % dq->cap];
+        found = true;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+static bool deque_steal(walk_deque *dq, walk_item *item) {
+    bool found = false;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom > dq->top) {
+        *item = dq->items[dq->top++ % dq->cap];
+        found = true;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+static void team_push(walk_worker *w, walk_item item) {
+    walk_team *t = w->team;
+    pthread_mutex_lock(&t->lock);
+    // counted before it can be stolen, or a thief finishing it first
+    // could take pending to 0 and end the walk for the idle workers
+    ++t->pending;
+    deque_push(&t->deques[w->id], item);
+    ++t->generation;
+    pthread_cond_signal(&t->cv);
+    pthread_mutex_unlock(&t->lock);
+}
+
+static void batch_flush(walk_worker *w) {
+    if (w->batch_len == 0) {
+        return;
+    }
+    pthread_mutex_lock(&w->team->sink_lock);
+    for (size_t i = 0; i < w->batch_len; ++i) {
+        lstime_emit_info_r(&w->fmt, w->ws.out, w->ws.list, w->ws.opts,
+                           &w->batch[i]);
+    }
+    if (lstime_limit_reached(w->ws.list, w->ws.opts, 0)) {
+        __atomic_store_n(&w->team->stop, true, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&w->team->sink_lock);
+    w->batch_len = 0;
+    lstime_arena_reset(&w->batch_paths);
+}
+
+static void walk_dir_item(walk_worker *w, walk_item item) {
+    walk_state *ws = &w->ws;
+    walk_team *t = w->team;
+    size_t path_len = path_append(ws, 0, item.path);
+    int dirfd = item.fd;
+    if (dirfd >= 0) {
+        __atomic_fetch_sub(&t->queued_fds, 1, __ATOMIC_RELAXED);
+    } else {
+        dirfd = open(item.path, DIR_OPEN_FLAGS | O_NOFOLLOW);
+        if (dirfd < 0) {
+            warn("open: %s: %s", item.path, strerror(errno));
+            free(item.path);
+            return;
+        }
+    }
+    free(item.path);
+
+    bool done = false;   // --limit reached
+    while (!done) {
+        ssize_t n = getdents64(dirfd, ws->dents, WALK_DENTS_LEN);
+        if (n < 0) {
+            ws->path[path_len] = '\0';
+            warn("getdents64: %s: %s", ws->path, strerror(errno));
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        for (ssize_t off = 0; off < n; ) {
+            struct dirent64 *d = (struct dirent64 *)(ws->dents + off);
+            off += d->d_reclen;
+            if (is_dot_or_dotdot(d->d_name)) {
+                continue;
+            }
+            if (__atomic_load_n(&t->stop, __ATOMIC_RELAXED)) {
+                done = true;
+                break;
+            }
+            path_append(ws, path_len, d->d_name);
+
+            lstime_info *info = &w->batch[w->batch_len];
+            info->sortkey = NULL;
+            if (lstime_stat_path_at(dirfd, d->d_name, info,
+                                    ws->opts->stat_flags) != 0) {
+                warn("lstime_stat_path: %s: %s", ws->path, strerror(errno));
+                continue;
+            }
+            info->path = lstime_arena_strdup(&w->batch_paths, ws->path);
+            if (++w->batch_len == w->batch_max) {
+                batch_flush(w);
+            }
+
+            if (entry_is_dir(dirfd, d)) {
+                walk_item child;
+                child.path = strdup(ws->path);
+                if (child.path == NULL) {
+                    err("strdup out of memory: %s", strerror(errno));
+                    exit(33);
+                }
+                child.fd = -1;
+                if (__atomic_add_fetch(&t->queued_fds, 1, __ATOMIC_RELAXED) <=
+                    WALK_MAX_QUEUED_FDS) {
+                    child.fd = openat(dirfd, d->d_name,
+                                      DIR_OPEN_FLAGS | O_NOFOLLOW);
+                }
+                if (child.fd < 0) {
+                    __atomic_fetch_sub(&t->queued_fds, 1, __ATOMIC_RELAXED);
+                }
+                team_push(w, child);
+            }
+        }
+    }
+    close(dirfd);
+    batch_flush(w);
+}
+
+static bool team_find_work(walk_worker *w, walk_item *item) {
+    walk_team *t = w->team;
+    if (deque_pop(&t->deques[w->id], item)) {
+        return true;
+    }
+    for (int i = 1; i < t->num_workers; ++i) {
+        int victim = (w->id + i) % t->num_workers;
+        if (deque_steal(&t->deques[victim], item)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *walk_worker_main(void *arg) {
+    walk_worker *w = arg;
+    walk_team *t = w->team;
+    walk_item item;
+
+    for (;;) {
+        pthread_mutex_lock(&t->lock);
+        unsigned long gen = t->generation;
+        pthread_mutex_unlock(&t->lock);
+
+        if (team_find_work(w, &item)) {
+            if (__atomic_load_n(&t->stop, __ATOMIC_RELAXED)) {
+                // --limit reached, drop the directory unread
+                if (item.fd >= 0) {
+                    __atomic_fetch_sub(&t->queued_fds, 1, __ATOMIC_RELAXED);
+                    close(item.fd);
+                }
+                free(item.path);
+            } else {
+                walk_dir_item(w, item);
+            }
+            pthread_mutex_lock(&t->lock);
+            if (--t->pending == 0) {
+                pthread_cond_broadcast(&t->cv);
+            }
+            pthread_mutex_unlock(&t->lock);
+            continue;
+        }
+
+        pthread_mutex_lock(&t->lock);
+        while (t->pending > 0 && t->generation == gen) {
+            pthread_cond_wait(&t->cv, &t->lock);
+        }
+        bool finished = (t->pending == 0);
+        pthread_mutex_unlock(&t->lock);
+        if (finished) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void walk_parallel(const walk_state *ws, int dirfd, int jobs) {
+    walk_team team;
+    memset(&team, 0, sizeof(team));
+    pthread_mutex_init(&team.lock, NULL);
+    pthread_cond_init(&team.cv, NULL);
+    pthread_mutex_init(&team.sink_lock, NULL);
+    team.num_workers = jobs;
+    team.deques = calloc(jobs, sizeof(walk_deque));
+    walk_worker *workers = calloc(jobs, sizeof(walk_worker));
+    pthread_t *threads = calloc(jobs, sizeof(pthread_t));
+    if (team.deques == NULL || workers == NULL || threads == NULL) {
+        err("walk team out of memory: %s", strerror(errno));
+        exit(43);
+    }
+    for (int i = 0; i < jobs; ++i) {
+        pthread_mutex_init(&team.deques[i].lock, NULL);
+        workers[i].team = &team;
+        workers[i].id = i;
+        workers[i].ws.out = ws->out;
+        workers[i].ws.list = ws->list;
+        workers[i].ws.opts = ws->opts;
+        workers[i].batch_max = WALK_BATCH_LEN;
+        if (lstime_limit_reached(ws->list, ws->opts, WALK_BATCH_LEN)) {
+            // a smaller batch, so not many entries are stat'ed past it
+            workers[i].batch_max = MAX(1, ws->opts->limit - ws->list->num_seen);
+        }
+        workers[i].ws.dents = malloc(WALK_DENTS_LEN);
+        workers[i].batch = malloc(WALK_BATCH_LEN * sizeof(lstime_info));
+        if (workers[i].ws.dents == NULL || workers[i].batch == NULL) {
+            err("walk worker out of memory: %s", strerror(errno));
+            exit(43);
+        }
+    }
+
+    walk_item root;
+    root.path = strdup(ws->path);
+    if (root.path == NULL) {
+        err("strdup out of memory: %s", strerror(errno));
+        exit(33);
+    }
+    root.fd = dirfd;
+    team.queued_fds = 1;
+    team_push(&workers[0], root);
+
+    for (int i = 0; i < jobs; ++i) {
+        int rc = pthread_create(&threads[i], NULL, walk_worker_main, &workers[i]);
+        if (rc != 0) {
+            err("pthread_create: %s", strerror(rc));
+            exit(41);
+        }
+    }
+    for (int i = 0; i < jobs; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < jobs; ++i) {
+        pthread_mutex_destroy(&team.deques[i].lock);
+        free(team.deques[i].items);
+        free(workers[i].ws.dents);
+        free(workers[i].ws.path);
+        free(workers[i].batch);
+        lstime_arena_free(&workers[i].batch_paths);
+        lstime_format_ctx_free(&workers[i].fmt);
+    }
+    free(threads);
+    free(workers);
+    free(team.deques);
+    pthread_mutex_destroy(&team.sink_lock);
+    pthread_cond_destroy(&team.cv);
+    pthread_mutex_destroy(&team.lock);
+}
+
+void lstime_walk_path(lstime_writer *out,
+                      arr_wrapper *list,
+                      const lstime_options *opts,
+                      const char *path) {
+    walk_state ws;
+    memset(&ws, 0, sizeof(ws));
+    ws.out = out;
+    ws.list = list;
+    ws.opts = opts;
+    size_t path_len = path_append(&ws, 0, path);
+
+    // the starting path itself is handled like a non-recursive path
+    lstime_info info;
+    info.path = path;
+    info.sortkey = NULL;
+    if (lstime_stat_path(&info, opts->stat_flags) != 0) {
+        err("lstime_stat_path: %s: %s", info.path, strerror(errno));
+        exit(3);
+    }
+    lstime_emit_info(out, list, opts, &info);
+    if (lstime_limit_reached(list, opts, 0)) {
+        free(ws.path);
+        return;
+    }
+
+    int flags = DIR_OPEN_FLAGS;
+    if (opts->stat_flags & AT_SYMLINK_NOFOLLOW) {
+        flags |= O_NOFOLLOW;
+    }
+    int fd = open(path, flags);
+    if (fd < 0) {
+        if (errno != ENOTDIR && errno != ELOOP) {
+            warn("open: %s: %s", path, strerror(errno));
+        }
+        free(ws.path);
+        return;
+    }
+
+    if (opts->jobs > 1) {
+        walk_parallel(&ws, fd, opts->jobs);
+        free(ws.path);
+        return;
+    }
+
+    ws.dents = malloc(WALK_DENTS_LEN);
+    if (ws.dents == NULL) {
+        err("getdents64 buffer out of memory: %s", strerror(errno));
+        exit(43);
+    }
+    walk_dir(&ws, fd, path_len, 0);
+    free(ws.dents);
+    free(ws.path);
+}
@@ -0,0 +1,156 @@
+// SPDX-FileCopyrightText: © 2023 Daniel D. Mickey III
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "lstime_private.h"
+
+// Output layer: items are appended to a large user-space buffer that is
+// flushed with write(2)/writev(2) in big chunks, avoiding stdio locking
+// and per-field call overhead.  When there is no file descriptor (like
+// an open_memstream in the tests), the chunks go through fwrite instead.
+
+static lstime_writer *exit_writer = NULL;
+
+// error exits (like a failed stat) keep the output already produced
+static void writer_atexit(void) {
+    lstime_writer *w = exit_writer;
+    exit_writer = NULL;
+    if (w == NULL || w->len == 0) {
+        return;
+    }
+    const char *ptr = w->buf;
+    size_t len = w->len;
+    w->len = 0;
+    while (len > 0) {  // best effort, no error exits from here
+        ssize_t n = write(w->fd, ptr, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        ptr += n;
+        len -= n;
+    }
+}
+
+static void writer_init(lstime_writer *w, FILE *fp, int fd, size_t cap) {
+    w->fp = fp;
+    w->fd = fd;
+    w->len = 0;
+    w->cap = MAX(cap, 1);
+    w->buf = malloc(w->cap);
+    if (w->buf == NULL) {
+        err("output buffer out of memory: %s", strerror(errno));
+        exit(46);
+    }
+}
+
+void lstime_writer_init_fp(lstime_writer *w, FILE *fp, size_t cap) {
+    writer_init(w, fp, -1, cap);
+}
+
+// take over fp's file descriptor; anything stdio buffered goes out first
+void lstime_writer_init_fd(lstime_writer *w, FILE *fp, size_t cap) {
+    static bool registered = false;
+    fflush(fp);
+    writer_init(w, fp, fileno(fp), cap);
+    if (!registered) {
+        atexit(writer_atexit);
+        registered = true;
+    }
+    exit_writer = w;
+}
+
+static void write_all(lstime_writer *w, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = (iovcnt == 1) ?
+            write(w->fd, iov[0].iov_base, iov[0].iov_len) :
+            writev(w->fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            exit_writer = NULL;  // nothing more can be written
+            err("write: %s", strerror(errno));
+            exit(47);
+        }
+        // skip fully written vectors, adjust a partial one
+        while (iovcnt > 0 && (size_t) n >= iov[0].iov_len) {
+            n -= iov[0].iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov[0].iov_base = (char *) iov[0].iov_base + n;
+            iov[0].iov_len -= n;
+        }
+    }
+}
+
+// write out the buffer followed by data (which may be NULL)
+static void writer_drain(lstime_writer *w, const char *data, size_t len) {
+    if (w->fd < 0) {
+        if (fwrite(w->buf, 1, w->len, w->fp) != w->len ||
+            (len > 0 && fwrite(data, 1, len, w->fp) != len)) {
+            err("fwrite: %s", strerror(errno));
+            exit(47);
+        }
+    } else {
+        struct iovec iov[2];
+        int iovcnt = 0;
+        if (w->len > 0) {
+            iov[iovcnt].iov_base = w->buf;
+            iov[iovcnt].iov_len = w->len;
+            ++iovcnt;
+        }
+        if (len > 0) {
+            iov[iovcnt].iov_base = (void *) data;  // override const
+            iov[iovcnt].iov_len = len;
+            ++iovcnt;
+        }
+        write_all(w, iov, iovcnt);
+    }
+    w->len = 0;
+}
+
+void lstime_writer_write(lstime_writer *w, const char *data, size_t len) {
+    if (len <= w->cap - w->len) {
+        memcpy(w->buf + w->len, data, len);
+        w->len += len;
+        return;
+    }
+    if (len >= w->cap) {
+        writer_drain(w, data, len);  // too big to buffer, one writev
+        return;
+    }
+    writer_drain(w, NULL, 0);
+    memcpy(w->buf, data, len);
+    w->len = len;
+}
+
+void lstime_writer_puts(lstime_writer *w, const char *str) {
+    lstime_writer_write(w, str, strlen(str));
+}
+
+void lstime_writer_flush(lstime_writer *w) {
+    if (w->len > 0) {
+        writer_drain(w, NULL, 0);
+    }
+    if (w->fd < 0 && fflush(w->fp) != 0) {
+        err("fflush: %s", strerror(errno));
+        exit(47);
+    }
+}
+
+void lstime_writer_finit(lstime_writer *w) {
+    lstime_writer_flush(w);
+    if (exit_writer == w) {
+        exit_writer = NULL;
+    }
+    free(w->buf);
+    w->buf = NULL;
+    w->cap = 0;
+}